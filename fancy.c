@@ -1,47 +1,1116 @@
 // (c) 2020 shdown
 // This code is licensed under MIT license (see LICENSE.MIT for details)
 
+// For 'MAP_ANONYMOUS' and 'madvise()'.
+#define _DEFAULT_SOURCE
+
 #include "fancy.h"
+#include "tpool.h"
+#include <stddef.h>
+#include <sys/mman.h>
 #include "libdeci-kara/decikara.h"
 #include "libdeci-ntt/decintt.h"
 #include "libdeci-newt/decinewt.h"
 
+#if defined(__x86_64__) && defined(__GNUC__)
+# define FANCY_HAVE_X86_KERNELS 1
+# include <immintrin.h>
+#else
+# define FANCY_HAVE_X86_KERNELS 0
+#endif
+
+static FancyCutoffs cutoffs = {
+    .mul_basecase = 30,
+    .mul_karatsuba = 75,
+    .mul_toom3 = 300,
+    .mul_parallel = 2000,
+
+    .div_basecase = 75,
+    .div_bz = 2000,
+
+    .gcd_half = 300,
+};
+
+// Scratch arena.
+//
+// The kernels below borrow their scratch space from a LIFO arena instead of calling 'malloc()'
+// each time. The arena is a chain of blocks; only the top one is allocated from. A block that is
+// not the bottom one is released as soon as it becomes empty, and once the whole arena becomes
+// empty, the bottom block is replaced with one big enough for the peak usage of that run (unless
+// that exceeds 'SCRATCH_KEEP_MAX'), so that steady-state workloads stop allocating altogether.
+// Blocks of at least 'SCRATCH_MMAP_MIN' bytes are mapped directly, with a transparent huge page
+// hint where available.
+//
+// Each thread has an arena of its own.
+
 enum {
-    MUL_BASECASE_CUTOFF = 30,
-    MUL_KARATSUBA_CUTOFF = 75,
+    SCRATCH_ALIGN = 64,
+    SCRATCH_BLOCK_MIN = 64 * 1024,
+    SCRATCH_MMAP_MIN = 2 * 1024 * 1024,
+    SCRATCH_KEEP_MAX = 64 * 1024 * 1024,
+};
+
+typedef struct ScratchBlock {
+    struct ScratchBlock *prev;
+    size_t size;
+    size_t used;
+    bool mapped;
+} ScratchBlock;
+
+#define SCRATCH_HDR_SIZE \
+    ((sizeof(ScratchBlock) + SCRATCH_ALIGN - 1) / SCRATCH_ALIGN * SCRATCH_ALIGN)
+
+static __thread ScratchBlock *scratch_top = NULL;
+static __thread FancyScratchStats scratch_stats = {0};
+
+// Peak usage since the arena was last empty.
+static __thread size_t scratch_run_peak = 0;
+
+static inline char *scratch_block_data(ScratchBlock *b)
+{
+    return ((char *) b) + SCRATCH_HDR_SIZE;
+}
+
+static ScratchBlock *scratch_block_new(size_t size, ScratchBlock *prev)
+{
+    size_t total = uu_add_zu_or_saturate(size, SCRATCH_HDR_SIZE);
+    if (UU_UNLIKELY(total == SIZE_MAX))
+        UU_PANIC_OOM();
+
+    ScratchBlock *b = NULL;
+    bool mapped = false;
+#if defined(MAP_ANONYMOUS)
+    if (total >= SCRATCH_MMAP_MIN) {
+        void *p = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p != MAP_FAILED) {
+# if defined(MADV_HUGEPAGE)
+            (void) madvise(p, total, MADV_HUGEPAGE);
+# endif
+            b = p;
+            mapped = true;
+        }
+    }
+#endif
+    if (!b)
+        b = uu_xmalloc(total, 1);
+
+    *b = (ScratchBlock) {
+        .prev = prev,
+        .size = size,
+        .used = 0,
+        .mapped = mapped,
+    };
+    ++scratch_stats.nblocks;
+    return b;
+}
+
+static void scratch_block_free(ScratchBlock *b)
+{
+    if (b->mapped)
+        munmap(b, b->size + SCRATCH_HDR_SIZE);
+    else
+        free(b);
+}
+
+static inline size_t scratch_round(size_t nbytes)
+{
+    size_t r = uu_add_zu_or_saturate(nbytes, SCRATCH_ALIGN - 1);
+    if (UU_UNLIKELY(r == SIZE_MAX))
+        UU_PANIC_OOM();
+    return r / SCRATCH_ALIGN * SCRATCH_ALIGN;
+}
+
+static void *scratch_push(size_t nbytes)
+{
+    nbytes = scratch_round(nbytes);
+
+    ScratchBlock *b = scratch_top;
+    if (UU_UNLIKELY(!b || b->size - b->used < nbytes)) {
+        size_t size = b ? uu_mul_zu_or_saturate(b->size, 2) : SCRATCH_BLOCK_MIN;
+        if (size < nbytes)
+            size = nbytes;
+        ScratchBlock *prev = b;
+        if (b && !b->used) {
+            // An empty block is replaced rather than stacked on, so that only the top block can
+            // be empty.
+            prev = b->prev;
+            scratch_block_free(b);
+        }
+        b = scratch_top = scratch_block_new(size, prev);
+    }
+
+    void *r = scratch_block_data(b) + b->used;
+    b->used += nbytes;
+
+    size_t cur = scratch_stats.cur_bytes += nbytes;
+    if (scratch_run_peak < cur)
+        scratch_run_peak = cur;
+    if (scratch_stats.peak_bytes < cur)
+        scratch_stats.peak_bytes = cur;
+    return r;
+}
+
+// Releases 'p' and everything pushed after it.
+static void scratch_pop(void *p)
+{
+    ScratchBlock *b = scratch_top;
+    size_t new_used = ((char *) p) - scratch_block_data(b);
+    scratch_stats.cur_bytes -= b->used - new_used;
+    b->used = new_used;
+
+    if (new_used)
+        return;
+
+    if (b->prev) {
+        scratch_top = b->prev;
+        scratch_block_free(b);
+        b = scratch_top;
+        if (b->used || b->prev)
+            return;
+    }
+
+    // The arena is empty now.
+    size_t want = scratch_run_peak;
+    scratch_run_peak = 0;
+    if (b->size > SCRATCH_KEEP_MAX) {
+        scratch_block_free(b);
+        scratch_top = NULL;
+    } else if (b->size < want && want <= SCRATCH_KEEP_MAX) {
+        scratch_block_free(b);
+        scratch_top = scratch_block_new(want, NULL);
+    }
+}
+
+// Frees the (empty) arena of the calling thread.
+static void scratch_release(void)
+{
+    while (scratch_top) {
+        ScratchBlock *prev = scratch_top->prev;
+        scratch_block_free(scratch_top);
+        scratch_top = prev;
+    }
+}
+
+FancyScratchStats fancy_scratch_stats(void)
+{
+    return scratch_stats;
+}
+
+bool fancy_set_nthreads(size_t n)
+{
+    if (n <= 1) {
+        tpool_stop();
+        return true;
+    }
+    return tpool_start(n - 1, scratch_release);
+}
+
+FancyCutoffs fancy_get_cutoffs(void)
+{
+    return cutoffs;
+}
+
+void fancy_set_cutoffs(FancyCutoffs c)
+{
+    cutoffs = c;
+}
+
+bool fancy_cutoffs_parse(FancyCutoffs *c, const char *s)
+{
+    static const struct {
+        const char *name;
+        size_t offset;
+    } FIELDS[] = {
+        {"mul_basecase", offsetof(FancyCutoffs, mul_basecase)},
+        {"mul_karatsuba", offsetof(FancyCutoffs, mul_karatsuba)},
+        {"mul_toom3", offsetof(FancyCutoffs, mul_toom3)},
+        {"mul_parallel", offsetof(FancyCutoffs, mul_parallel)},
+        {"div_basecase", offsetof(FancyCutoffs, div_basecase)},
+        {"div_bz", offsetof(FancyCutoffs, div_bz)},
+        {"gcd_half", offsetof(FancyCutoffs, gcd_half)},
+    };
+
+    for (;;) {
+        s += strspn(s, " \t\n,");
+        if (*s == '\0')
+            return c->mul_basecase >= FANCY_MUL_BASECASE_MIN &&
+                   c->div_basecase >= FANCY_DIV_BASECASE_MIN &&
+                   c->gcd_half >= FANCY_GCD_HALF_MIN;
+
+        size_t nname = strcspn(s, "=");
+        if (s[nname] != '=')
+            return false;
+
+        size_t i = 0;
+        size_t nfields = sizeof(FIELDS) / sizeof(FIELDS[0]);
+        for (; i < nfields; ++i)
+            if (strlen(FIELDS[i].name) == nname && memcmp(FIELDS[i].name, s, nname) == 0)
+                break;
+        if (i == nfields)
+            return false;
+
+        s += nname + 1;
+        if (*s < '0' || *s > '9')
+            return false;
+        errno = 0;
+        char *endptr;
+        unsigned long long v = strtoull(s, &endptr, 10);
+        if (errno || v > SIZE_MAX)
+            return false;
+        *(size_t *) (((char *) c) + FIELDS[i].offset) = v;
+        s = endptr;
+    }
+}
+
+bool fancy_cutoffs_load(FancyCutoffs *c, const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return false;
+
+    // Comments are blanked out, so that each line can be parsed on its own.
+    FancyCutoffs r = *c;
+    char buf[1024];
+    bool ok = true;
+    while (ok && fgets(buf, sizeof(buf), f)) {
+        size_t nbuf = strlen(buf);
+        if (nbuf == sizeof(buf) - 1 && buf[nbuf - 1] != '\n' && !feof(f)) {
+            ok = false;
+            break;
+        }
+        buf[strcspn(buf, "#")] = '\0';
+        ok = fancy_cutoffs_parse(&r, buf);
+    }
+    if (ok && ferror(f))
+        ok = false;
+    else if (!ok)
+        errno = EINVAL;
+    fclose(f);
+
+    if (ok)
+        *c = r;
+    return ok;
+}
+
+// Word kernels.
+//
+// Additions, subtractions and basecase products go through a table of kernels chosen at startup
+// from what the CPU supports. The scalar kernels are those of libdeci and work everywhere.
+//
+// The x86 ones add and subtract several words at once: each lane computes its sum (or
+// difference) assuming no incoming carry, together with whether it generates a carry and whether it
+// would propagate one; the carries into all lanes then follow from a single binary addition of the
+// generate and propagate masks, as in a carry-lookahead adder. Products of 19-digit words have no
+// vector form, so their basecase products accumulate each column of partial products in three
+// words instead, and only reduce it modulo 'DECI_BASE' once per output word, using a precomputed
+// reciprocal of 'DECI_BASE' instead of a 128-bit division.
+
+typedef struct {
+    bool (*add)(deci_UWORD *wa, deci_UWORD *wa_end, deci_UWORD *wb, deci_UWORD *wb_end);
+    bool (*sub_raw)(deci_UWORD *wa, deci_UWORD *wa_end, deci_UWORD *wb, deci_UWORD *wb_end);
+    // Write all the 'nwa + nwb' (or '2 * nwa') words of 'out', which does not need to be zeroed.
+    void (*mul)(deci_UWORD *wa, size_t nwa, deci_UWORD *wb, size_t nwb, deci_UWORD *out);
+    void (*sqr)(deci_UWORD *wa, size_t nwa, deci_UWORD *out);
+} Kernels;
+
+static void mul_scalar(deci_UWORD *wa, size_t nwa, deci_UWORD *wb, size_t nwb, deci_UWORD *out)
+{
+    deci_zero_out_n(out, nwa + nwb);
+    deci_mul(wa, wa + nwa, wb, wb + nwb, out);
+}
+
+// Squares 'wa' with the schoolbook method, computing each cross product once.
+static void sqr_scalar(deci_UWORD *wa, size_t n, deci_UWORD *out)
+{
+    // Sum of 'wa[i] * wa[j]' for 'i < j'; row 'i' ends at 'out[i + n]', which no previous row
+    // has reached yet.
+    deci_zero_out_n(out, 2 * n);
+    for (size_t i = 0; i + 1 < n; ++i) {
+        deci_UWORD x = wa[i];
+        deci_UWORD carry = 0;
+        for (size_t j = i + 1; j < n; ++j) {
+            deci_DOUBLE_UWORD t = (deci_DOUBLE_UWORD) x * wa[j] + out[i + j] + carry;
+            out[i + j] = t % DECI_BASE;
+            carry = t / DECI_BASE;
+        }
+        out[i + n] = carry;
+    }
+    (void) deci_mul_uword(out, out + 2 * n, 2);
+
+    // Add the squares.
+    deci_UWORD carry = 0;
+    for (size_t i = 0; i < n; ++i) {
+        deci_DOUBLE_UWORD t = (deci_DOUBLE_UWORD) wa[i] * wa[i] + out[2 * i] + carry;
+        out[2 * i] = t % DECI_BASE;
+        t = t / DECI_BASE + out[2 * i + 1];
+        out[2 * i + 1] = t % DECI_BASE;
+        carry = t / DECI_BASE;
+    }
+}
+
+// Number of bits in a word, 'w' below.
+#define WORD_BITS ((unsigned) (CHAR_BIT * sizeof(deci_UWORD)))
+
+// 'floor((2^(2w) - 1) / DECI_BASE) - 2^w'. If 'DECI_BASE' has its top bit set, as it has with
+// 64-bit words, this is the reciprocal of Moller and Granlund, "Improved division by invariant
+// integers" (2011).
+#define BASE_RECIPROCAL ((deci_UWORD) (~(deci_DOUBLE_UWORD) 0 / DECI_BASE))
+#define BASE_IS_NORMALIZED ((DECI_BASE >> (WORD_BITS - 1)) != 0)
+
+// Divides 'hi * 2^w + lo' by 'DECI_BASE', where 'hi < DECI_BASE'; returns the quotient and stores
+// the remainder into '*r'.
+static inline UU_ALWAYS_INLINE deci_UWORD base_divrem(deci_UWORD hi, deci_UWORD lo, deci_UWORD *r)
+{
+    if (!BASE_IS_NORMALIZED) {
+        // A double word is then no wider than a machine word, and dividing it is cheap.
+        deci_DOUBLE_UWORD t = ((deci_DOUBLE_UWORD) hi << WORD_BITS) | lo;
+        *r = t % DECI_BASE;
+        return t / DECI_BASE;
+    }
+
+    deci_DOUBLE_UWORD q = (deci_DOUBLE_UWORD) BASE_RECIPROCAL * hi;
+    q += ((deci_DOUBLE_UWORD) hi << WORD_BITS) | lo;
+    deci_UWORD q1 = (deci_UWORD) (q >> WORD_BITS) + 1;
+    deci_UWORD q0 = (deci_UWORD) q;
+    deci_UWORD rem = lo - q1 * DECI_BASE;
+    if (rem > q0) {
+        --q1;
+        rem += DECI_BASE;
+    }
+    if (UU_UNLIKELY(rem >= DECI_BASE)) {
+        ++q1;
+        rem -= DECI_BASE;
+    }
+    *r = rem;
+    return q1;
+}
+
+static const Kernels KERNELS_SCALAR = {
+    .add = deci_add,
+    .sub_raw = deci_sub_raw,
+    .mul = mul_scalar,
+    .sqr = sqr_scalar,
+};
+
+static Kernels kernels = KERNELS_SCALAR;
+static FancyKernels kernels_kind = FANCY_KERNELS_SCALAR;
+
+#if FANCY_HAVE_X86_KERNELS
+
+// Both the 'add' and the 'sub_raw' kernels finish with these, which handle the words past the last
+// full vector.
+
+static inline UU_ALWAYS_INLINE bool add_tail(
+    deci_UWORD *wa, deci_UWORD *wa_end,
+    deci_UWORD *wb, deci_UWORD *wb_end,
+    bool c)
+{
+    for (; wb != wb_end; ++wa, ++wb) {
+        deci_UWORD x = *wa + c;
+        deci_UWORD y = DECI_BASE - *wb;
+        c = x >= y;
+        *wa = c ? x - y : x + *wb;
+    }
+    for (; c && wa != wa_end; ++wa) {
+        if (++*wa == DECI_BASE)
+            *wa = 0;
+        else
+            c = false;
+    }
+    return c;
+}
+
+static inline UU_ALWAYS_INLINE bool sub_tail(
+    deci_UWORD *wa, deci_UWORD *wa_end,
+    deci_UWORD *wb, deci_UWORD *wb_end,
+    bool c)
+{
+    for (; wb != wb_end; ++wa, ++wb) {
+        deci_UWORD y = *wb + c;
+        c = *wa < y;
+        *wa = c ? *wa + (DECI_BASE - y) : *wa - y;
+    }
+    for (; c && wa != wa_end; ++wa) {
+        if (*wa) {
+            --*wa;
+            c = false;
+        } else {
+            *wa = DECI_BASE - 1;
+        }
+    }
+    return c;
+}
+
+// Given the generate and propagate bits of 'nlanes' lanes and the incoming carry 'c', returns the
+// carries into the lanes, and sets 'c' to the outgoing one. The two masks must be disjoint.
+static inline UU_ALWAYS_INLINE unsigned lookahead(
+    unsigned g, unsigned p, unsigned nlanes, unsigned *c)
+{
+    unsigned t = (g | p) + g + *c;
+    *c = t >> nlanes;
+    return (t ^ p) & ((1u << nlanes) - 1);
+}
+
+__attribute__((target("avx2")))
+static bool add_avx2(deci_UWORD *wa, deci_UWORD *wa_end, deci_UWORD *wb, deci_UWORD *wb_end)
+{
+    const __m256i base = _mm256_set1_epi64x(DECI_BASE);
+    const __m256i max = _mm256_set1_epi64x(DECI_BASE - 1);
+    const __m256i sign = _mm256_set1_epi64x(INT64_MIN);
+    const __m256i bits = _mm256_setr_epi64x(1, 2, 4, 8);
+
+    unsigned c = 0;
+    for (; wb_end - wb >= 4; wa += 4, wb += 4) {
+        __m256i a = _mm256_loadu_si256((const __m256i *) wa);
+        __m256i b = _mm256_loadu_si256((const __m256i *) wb);
+        // The sum may wrap around, but then it is not 'DECI_BASE - 1', and 'sum - DECI_BASE' is
+        // right; the carry is generated if 'a >= DECI_BASE - b'.
+        __m256i sum = _mm256_add_epi64(a, b);
+        __m256i lt = _mm256_cmpgt_epi64(
+            _mm256_xor_si256(_mm256_sub_epi64(base, b), sign),
+            _mm256_xor_si256(a, sign));
+        unsigned g = ~_mm256_movemask_pd(_mm256_castsi256_pd(lt)) & 0xF;
+        __m256i pv = _mm256_cmpeq_epi64(sum, max);
+        unsigned p = _mm256_movemask_pd(_mm256_castsi256_pd(pv));
+
+        unsigned cin = lookahead(g, p, 4, &c);
+        __m256i cv = _mm256_cmpeq_epi64(_mm256_and_si256(_mm256_set1_epi64x(cin), bits), bits);
+        __m256i gv = _mm256_xor_si256(lt, _mm256_set1_epi64x(-1));
+        __m256i over = _mm256_or_si256(gv, _mm256_and_si256(pv, cv));
+
+        __m256i r = _mm256_sub_epi64(sum, cv);
+        r = _mm256_sub_epi64(r, _mm256_and_si256(over, base));
+        _mm256_storeu_si256((__m256i *) wa, r);
+    }
+    return add_tail(wa, wa_end, wb, wb_end, c);
+}
+
+__attribute__((target("avx2")))
+static bool sub_avx2(deci_UWORD *wa, deci_UWORD *wa_end, deci_UWORD *wb, deci_UWORD *wb_end)
+{
+    const __m256i base = _mm256_set1_epi64x(DECI_BASE);
+    const __m256i sign = _mm256_set1_epi64x(INT64_MIN);
+    const __m256i bits = _mm256_setr_epi64x(1, 2, 4, 8);
+
+    unsigned c = 0;
+    for (; wb_end - wb >= 4; wa += 4, wb += 4) {
+        __m256i a = _mm256_loadu_si256((const __m256i *) wa);
+        __m256i b = _mm256_loadu_si256((const __m256i *) wb);
+        __m256i diff = _mm256_sub_epi64(a, b);
+        __m256i gv = _mm256_cmpgt_epi64(_mm256_xor_si256(b, sign), _mm256_xor_si256(a, sign));
+        unsigned g = _mm256_movemask_pd(_mm256_castsi256_pd(gv));
+        __m256i pv = _mm256_cmpeq_epi64(a, b);
+        unsigned p = _mm256_movemask_pd(_mm256_castsi256_pd(pv));
+
+        unsigned cin = lookahead(g, p, 4, &c);
+        __m256i cv = _mm256_cmpeq_epi64(_mm256_and_si256(_mm256_set1_epi64x(cin), bits), bits);
+        __m256i under = _mm256_or_si256(gv, _mm256_and_si256(pv, cv));
+
+        __m256i r = _mm256_add_epi64(diff, cv);
+        r = _mm256_add_epi64(r, _mm256_and_si256(under, base));
+        _mm256_storeu_si256((__m256i *) wa, r);
+    }
+    return sub_tail(wa, wa_end, wb, wb_end, c);
+}
+
+__attribute__((target("avx512f")))
+static bool add_avx512(deci_UWORD *wa, deci_UWORD *wa_end, deci_UWORD *wb, deci_UWORD *wb_end)
+{
+    const __m512i base = _mm512_set1_epi64(DECI_BASE);
+    const __m512i max = _mm512_set1_epi64(DECI_BASE - 1);
+    const __m512i one = _mm512_set1_epi64(1);
+
+    unsigned c = 0;
+    for (; wb_end - wb >= 8; wa += 8, wb += 8) {
+        __m512i a = _mm512_loadu_si512(wa);
+        __m512i b = _mm512_loadu_si512(wb);
+        __m512i sum = _mm512_add_epi64(a, b);
+        unsigned g = _mm512_cmpge_epu64_mask(a, _mm512_sub_epi64(base, b));
+        unsigned p = _mm512_cmpeq_epu64_mask(sum, max);
+
+        unsigned cin = lookahead(g, p, 8, &c);
+        __m512i r = _mm512_mask_sub_epi64(sum, g | (p & cin), sum, base);
+        r = _mm512_mask_add_epi64(r, cin, r, one);
+        _mm512_storeu_si512(wa, r);
+    }
+    return add_tail(wa, wa_end, wb, wb_end, c);
+}
+
+__attribute__((target("avx512f")))
+static bool sub_avx512(deci_UWORD *wa, deci_UWORD *wa_end, deci_UWORD *wb, deci_UWORD *wb_end)
+{
+    const __m512i base = _mm512_set1_epi64(DECI_BASE);
+    const __m512i one = _mm512_set1_epi64(1);
+
+    unsigned c = 0;
+    for (; wb_end - wb >= 8; wa += 8, wb += 8) {
+        __m512i a = _mm512_loadu_si512(wa);
+        __m512i b = _mm512_loadu_si512(wb);
+        __m512i diff = _mm512_sub_epi64(a, b);
+        unsigned g = _mm512_cmplt_epu64_mask(a, b);
+        unsigned p = _mm512_cmpeq_epu64_mask(a, b);
+
+        unsigned cin = lookahead(g, p, 8, &c);
+        __m512i r = _mm512_mask_add_epi64(diff, g | (p & cin), diff, base);
+        r = _mm512_mask_sub_epi64(r, cin, r, one);
+        _mm512_storeu_si512(wa, r);
+    }
+    return sub_tail(wa, wa_end, wb, wb_end, c);
+}
+
+// A column of partial products: 'hi * 2^(2w) + lo'.
+typedef struct {
+    deci_DOUBLE_UWORD lo;
+    deci_UWORD hi;
+} Column;
+
+static inline UU_ALWAYS_INLINE void column_add(Column *col, deci_DOUBLE_UWORD x)
+{
+    col->lo += x;
+    col->hi += col->lo < x;
+}
+
+// Stores the column modulo 'DECI_BASE' into '*out' and returns the column divided by 'DECI_BASE',
+// which is where the next column starts.
+static inline UU_ALWAYS_INLINE deci_DOUBLE_UWORD column_reduce(Column col, deci_UWORD *out)
+{
+    deci_UWORD r;
+    deci_UWORD q1 = base_divrem(col.hi, (deci_UWORD) (col.lo >> WORD_BITS), &r);
+    deci_UWORD q0 = base_divrem(r, (deci_UWORD) col.lo, out);
+    return ((deci_DOUBLE_UWORD) q1 << WORD_BITS) | q0;
+}
+
+static inline UU_ALWAYS_INLINE void mul_columns(
+    deci_UWORD *wa, size_t nwa,
+    deci_UWORD *wb, size_t nwb,
+    deci_UWORD *out)
+{
+    deci_DOUBLE_UWORD carry = 0;
+    for (size_t k = 0; k + 1 < nwa + nwb; ++k) {
+        size_t i = k < nwb ? 0 : k - nwb + 1;
+        size_t i_end = k < nwa ? k + 1 : nwa;
+        Column col = {.lo = carry, .hi = 0};
+        for (; i < i_end; ++i)
+            column_add(&col, (deci_DOUBLE_UWORD) wa[i] * wb[k - i]);
+        carry = column_reduce(col, &out[k]);
+    }
+    out[nwa + nwb - 1] = (deci_UWORD) carry;
+}
+
+static inline UU_ALWAYS_INLINE void sqr_columns(deci_UWORD *wa, size_t n, deci_UWORD *out)
+{
+    deci_DOUBLE_UWORD carry = 0;
+    for (size_t k = 0; k + 1 < 2 * n; ++k) {
+        // Cross products 'wa[i] * wa[j]' with 'i < j', doubled, then the square if 'k' is even.
+        size_t i = k < n ? 0 : k - n + 1;
+        size_t j = k - i;
+        Column col = {0};
+        for (; i < j; ++i, --j)
+            column_add(&col, (deci_DOUBLE_UWORD) wa[i] * wa[j]);
+        col.hi = (col.hi << 1) | (deci_UWORD) (col.lo >> (2 * WORD_BITS - 1));
+        col.lo <<= 1;
+        if (i == j)
+            column_add(&col, (deci_DOUBLE_UWORD) wa[i] * wa[i]);
+        column_add(&col, carry);
+        carry = column_reduce(col, &out[k]);
+    }
+    out[2 * n - 1] = (deci_UWORD) carry;
+}
+
+__attribute__((target("avx2,bmi2")))
+static void mul_avx2(deci_UWORD *wa, size_t nwa, deci_UWORD *wb, size_t nwb, deci_UWORD *out)
+{
+    mul_columns(wa, nwa, wb, nwb, out);
+}
+
+__attribute__((target("avx2,bmi2")))
+static void sqr_avx2(deci_UWORD *wa, size_t n, deci_UWORD *out)
+{
+    sqr_columns(wa, n, out);
+}
+
+static const Kernels KERNELS_AVX2 = {
+    .add = add_avx2,
+    .sub_raw = sub_avx2,
+    .mul = mul_avx2,
+    .sqr = sqr_avx2,
+};
 
-    DIV_BASECASE_CUTOFF = 75,
+static const Kernels KERNELS_AVX512 = {
+    .add = add_avx512,
+    .sub_raw = sub_avx512,
+    .mul = mul_avx2,
+    .sqr = sqr_avx2,
 };
 
+#endif
+
+static const char *const KERNELS_NAMES[] = {
+    [FANCY_KERNELS_SCALAR] = "scalar",
+    [FANCY_KERNELS_AVX2] = "avx2",
+    [FANCY_KERNELS_AVX512] = "avx512",
+};
+
+FancyKernels fancy_detect_kernels(void)
+{
+#if FANCY_HAVE_X86_KERNELS
+    // The vector kernels work on 64-bit lanes.
+    if (sizeof(deci_UWORD) != 8)
+        return FANCY_KERNELS_SCALAR;
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("bmi2"))
+        return FANCY_KERNELS_AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2"))
+        return FANCY_KERNELS_AVX2;
+#endif
+    return FANCY_KERNELS_SCALAR;
+}
+
+FancyKernels fancy_get_kernels(void)
+{
+    return kernels_kind;
+}
+
+bool fancy_set_kernels(FancyKernels k)
+{
+    if (k > fancy_detect_kernels())
+        return false;
+    switch (k) {
+    case FANCY_KERNELS_SCALAR:
+        kernels = KERNELS_SCALAR;
+        break;
+#if FANCY_HAVE_X86_KERNELS
+    case FANCY_KERNELS_AVX2:
+        kernels = KERNELS_AVX2;
+        break;
+    case FANCY_KERNELS_AVX512:
+        kernels = KERNELS_AVX512;
+        break;
+#endif
+    default:
+        return false;
+    }
+    kernels_kind = k;
+    return true;
+}
+
+const char *fancy_kernels_name(FancyKernels k)
+{
+    return KERNELS_NAMES[k];
+}
+
+bool fancy_kernels_parse(FancyKernels *k, const char *s)
+{
+    for (size_t i = 0; i < sizeof(KERNELS_NAMES) / sizeof(KERNELS_NAMES[0]); ++i) {
+        if (strcmp(KERNELS_NAMES[i], s) == 0) {
+            *k = (FancyKernels) i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool fancy_add(deci_UWORD *wa, deci_UWORD *wa_end, deci_UWORD *wb, deci_UWORD *wb_end)
+{
+    return kernels.add(wa, wa_end, wb, wb_end);
+}
+
+bool fancy_sub_raw(deci_UWORD *wa, deci_UWORD *wa_end, deci_UWORD *wb, deci_UWORD *wb_end)
+{
+    return kernels.sub_raw(wa, wa_end, wb, wb_end);
+}
+
+void fancy_lincomb(
+        deci_UWORD *wa, size_t nwa, deci_UWORD x,
+        deci_UWORD *wb, size_t nwb, deci_UWORD y,
+        deci_UWORD *out)
+{
+    // The carry into each word lies in '[-2^(w-2), 2^(w-2)]'; it is kept biased by 'BIAS', and the
+    // dividend by 'BIAS * DECI_BASE', so that a single unsigned division per word handles both
+    // products.
+    const deci_UWORD BIAS = ((deci_UWORD) 1) << (WORD_BITS - 2);
+    const deci_DOUBLE_UWORD BIAS_REST = (deci_DOUBLE_UWORD) BIAS * (DECI_BASE - 1);
+
+    size_t n = nwa > nwb ? nwa : nwb;
+    deci_UWORD c = BIAS;
+    for (size_t i = 0; i < n; ++i) {
+        deci_DOUBLE_UWORD t = (deci_DOUBLE_UWORD) x * (i < nwa ? wa[i] : 0) + c + BIAS_REST;
+        t -= (deci_DOUBLE_UWORD) y * (i < nwb ? wb[i] : 0);
+        c = base_divrem((deci_UWORD) (t >> WORD_BITS), (deci_UWORD) t, &out[i]);
+    }
+    out[n] = c - BIAS;
+}
+
+// Signed integers used by the Toom-3 evaluation and interpolation steps. The width is fixed per
+// step and is always large enough to hold any intermediate value.
+typedef struct {
+    deci_UWORD *w;
+    bool neg;
+} Signed;
+
+// 'x = src' where 'src' is a non-negative 'nsrc'-word integer.
+static inline void signed_load(Signed x, size_t n, deci_UWORD *src, size_t nsrc)
+{
+    deci_memcpy(x.w, src, nsrc);
+    deci_zero_out_n(x.w + nsrc, n - nsrc);
+}
+
+// 'x += y' if 'sub' is false, 'x -= y' otherwise.
+static inline void signed_add(Signed *x, Signed y, size_t n, bool sub)
+{
+    if (x->neg ^ y.neg ^ sub) {
+        if (kernels.sub_raw(x->w, x->w + n, y.w, y.w + n)) {
+            deci_uncomplement(x->w, x->w + n);
+            x->neg = !x->neg;
+        }
+    } else {
+        (void) kernels.add(x->w, x->w + n, y.w, y.w + n);
+    }
+}
+
+// 'x = y + z' if 'sub' is false, 'x = y - z' otherwise.
+static inline void signed_add3(Signed *x, Signed y, Signed z, size_t n, bool sub)
+{
+    deci_memcpy(x->w, y.w, n);
+    x->neg = y.neg;
+    signed_add(x, z, n, sub);
+}
+
+// 'x /= d', where 'x' is known to be divisible by 'd'.
+static inline void signed_divexact(Signed x, size_t n, deci_UWORD d)
+{
+    deci_UWORD r = deci_divmod_uword(x.w, x.w + n, d);
+    assert(r == 0);
+    (void) r;
+}
+
+// 'r = x * y'; 'x' and 'y' are 'n' words wide, 'r' is '2 * n' words wide.
+static inline void signed_mul(Signed *r, Signed x, Signed y, size_t n)
+{
+    size_t nx = deci_normalize_n(x.w, n);
+    size_t ny = deci_normalize_n(y.w, n);
+    if (nx && ny) {
+        fancy_mul(x.w, nx, y.w, ny, r->w);
+        deci_zero_out_n(r->w + nx + ny, 2 * n - nx - ny);
+    } else {
+        deci_zero_out_n(r->w, 2 * n);
+    }
+    r->neg = x.neg ^ y.neg;
+}
+
+// Adds the non-negative 'n'-word 'x' to 'out[off ... nout - 1]'; the sum must fit.
+static inline void add_at(deci_UWORD *out, size_t nout, size_t off, Signed x, size_t n)
+{
+    n = deci_normalize_n(x.w, n);
+    if (!n)
+        return;
+    assert(!x.neg);
+    (void) kernels.add(out + off, out + nout, x.w, x.w + n);
+}
+
+// Toom-3 multiplication: both operands are split into three 'k'-word parts, the resulting
+// polynomials are evaluated at 0, 1, -1, -2 and infinity, the five pointwise products are computed
+// with 'fancy_mul()', and the coefficients are interpolated using Bodrato's sequence.
+static void toom3_mul(
+    deci_UWORD *wa, size_t nwa,
+    deci_UWORD *wb, size_t nwb,
+    deci_UWORD *out)
+{
+    size_t nout = nwa + nwb;
+    size_t k = ((nwa > nwb ? nwa : nwb) + 2) / 3;
+    // Width of the evaluated values, and of the pointwise products.
+    size_t n1 = k + 2;
+    size_t n2 = 2 * n1;
+
+    deci_UWORD *scratch = scratch_push(uu_mul_zu_or_saturate(12 * n1 + 5 * n2, sizeof(deci_UWORD)));
+    deci_UWORD *s = scratch;
+
+    // 'ev[0]' holds 'p(0)', 'p(1)', 'p(-1)', 'p(-2)', 'p(inf)' for 'a', 'ev[1]' the same for 'b'.
+    // When squaring, 'b' is not evaluated separately, and all the pointwise products are squares.
+    Signed ev[2][5];
+    deci_UWORD *w[2] = {wa, wb};
+    size_t nw[2] = {nwa, nwb};
+    bool square = wa == wb && nwa == nwb;
+    for (int i = 0; i < (square ? 1 : 2); ++i) {
+        Signed *e = ev[i];
+        for (int j = 0; j < 5; ++j) {
+            e[j] = (Signed) {.w = s, .neg = false};
+            s += n1;
+        }
+        Signed a1 = {.w = s, .neg = false};
+        s += n1;
+
+        size_t rest = nw[i];
+        size_t np0 = rest < k ? rest : k;
+        rest -= np0;
+        size_t np1 = rest < k ? rest : k;
+        rest -= np1;
+        signed_load(e[0], n1, w[i], np0);
+        signed_load(a1, n1, w[i] + k, np1);
+        signed_load(e[4], n1, w[i] + 2 * k, rest);
+
+        // 'p(1) = a0 + a1 + a2', 'p(-1) = a0 - a1 + a2', 'p(-2) = (p(-1) + a2) * 2 - a0'.
+        signed_add3(&e[2], e[0], e[4], n1, false);
+        signed_add3(&e[1], e[2], a1, n1, false);
+        signed_add(&e[2], a1, n1, true);
+        signed_add3(&e[3], e[2], e[4], n1, false);
+        (void) deci_mul_uword(e[3].w, e[3].w + n1, 2);
+        signed_add(&e[3], e[0], n1, true);
+    }
+
+    if (square)
+        memcpy(ev[1], ev[0], sizeof(ev[0]));
+
+    Signed r[5];
+    for (int j = 0; j < 5; ++j) {
+        r[j] = (Signed) {.w = s, .neg = false};
+        s += n2;
+        signed_mul(&r[j], ev[0][j], ev[1][j], n1);
+    }
+
+    // Interpolate: afterwards, 'r[j]' is the coefficient at 'x^j' of the product polynomial.
+    Signed r0 = r[0], r1 = r[1], rm1 = r[2], rm2 = r[3], rinf = r[4];
+    // 'r3 = (r(-2) - r(1)) / 3'; it takes the place of 'r(-2)'.
+    Signed r3 = rm2;
+    signed_add(&r3, r1, n2, true);
+    signed_divexact(r3, n2, 3);
+    // 'r1 = (r(1) - r(-1)) / 2'.
+    signed_add(&r1, rm1, n2, true);
+    signed_divexact(r1, n2, 2);
+    // 'r2 = r(-1) - r(0)'; it takes the place of 'r(-1)'.
+    Signed r2 = rm1;
+    signed_add(&r2, r0, n2, true);
+    // 'r3 = (r2 - r3) / 2 + 2 * r(inf)'.
+    r3.neg = !r3.neg;
+    signed_add(&r3, r2, n2, false);
+    signed_divexact(r3, n2, 2);
+    signed_add(&r3, rinf, n2, false);
+    signed_add(&r3, rinf, n2, false);
+    // 'r2 = r2 + r1 - r(inf)'.
+    signed_add(&r2, r1, n2, false);
+    signed_add(&r2, rinf, n2, true);
+    // 'r1 = r1 - r3'.
+    signed_add(&r1, r3, n2, true);
+
+    deci_zero_out_n(out, nout);
+    add_at(out, nout, 0, r0, n2);
+    add_at(out, nout, k, r1, n2);
+    add_at(out, nout, 2 * k, r2, n2);
+    add_at(out, nout, 3 * k, r3, n2);
+    add_at(out, nout, 4 * k, rinf, n2);
+
+    scratch_pop(scratch);
+}
+
+typedef struct {
+    deci_UWORD *wa;
+    size_t nwa;
+    deci_UWORD *wb;
+    size_t nwb;
+    deci_UWORD *out;
+} MulTask;
+
+static void mul_task_func(void *arg)
+{
+    MulTask *t = arg;
+    fancy_mul(t->wa, t->nwa, t->wb, t->nwb, t->out);
+}
+
+// One level of Karatsuba with the three sub-products computed in parallel. Each of them goes
+// through 'fancy_mul()' on its own, so a sub-product that is still large splits further.
+//
+// Returns false, doing nothing, if the operands are too unbalanced to be split at the same point.
+static bool parallel_mul(
+    deci_UWORD *wa, size_t nwa,
+    deci_UWORD *wb, size_t nwb,
+    deci_UWORD *out)
+{
+    size_t h = ((nwa > nwb ? nwa : nwb) + 1) / 2;
+    if (nwa <= h || nwb <= h)
+        return false;
+
+    bool square = wa == wb && nwa == nwb;
+
+    // 'z0 = a0 * b0' goes to 'out[0 ... 2h - 1]', 'z2 = a1 * b1' to the rest of 'out'.
+    MulTask t0 = {wa, h, wb, h, out};
+    MulTask t2 = {wa + h, nwa - h, wb + h, nwb - h, out + 2 * h};
+    TPoolTask tasks[2] = {
+        {.func = mul_task_func, .arg = &t0},
+        {.func = mul_task_func, .arg = &t2},
+    };
+    tpool_submit(&tasks[0]);
+    tpool_submit(&tasks[1]);
+
+    // Meanwhile, 'z1 = (a0 + a1) * (b0 + b1)'.
+    size_t n1 = h + 1;
+    deci_UWORD *sa = scratch_push(uu_mul_zu_or_saturate(4 * n1, sizeof(deci_UWORD)));
+    deci_UWORD *sb = sa + n1;
+    deci_UWORD *z1 = sb + n1;
+
+    deci_memcpy(sa, wa, h);
+    sa[h] = 0;
+    (void) kernels.add(sa, sa + n1, wa + h, wa + nwa);
+    if (!square) {
+        deci_memcpy(sb, wb, h);
+        sb[h] = 0;
+        (void) kernels.add(sb, sb + n1, wb + h, wb + nwb);
+    }
+    size_t nsa = deci_normalize_n(sa, n1);
+    size_t nsb = square ? nsa : deci_normalize_n(sb, n1);
+    fancy_mul(sa, nsa, square ? sa : sb, nsb, z1);
+    size_t nz1 = nsa + nsb;
+
+    tpool_wait(&tasks[0]);
+    tpool_wait(&tasks[1]);
+
+    // 'out += (z1 - z0 - z2) * B^h'.
+    (void) kernels.sub_raw(z1, z1 + nz1, out, out + deci_normalize_n(out, 2 * h));
+    size_t nz2 = deci_normalize_n(out + 2 * h, nwa + nwb - 2 * h);
+    (void) kernels.sub_raw(z1, z1 + nz1, out + 2 * h, out + 2 * h + nz2);
+    nz1 = deci_normalize_n(z1, nz1);
+    if (nz1)
+        (void) kernels.add(out + h, out + nwa + nwb, z1, z1 + nz1);
+
+    scratch_pop(sa);
+    return true;
+}
+
+// Multiplies the long 'wa' by the short 'wb' by splitting 'wa' into chunks no longer than 'wb', so
+// that each partial product is (nearly) balanced, and accumulating the partial products.
+static void unbalanced_mul(
+    deci_UWORD *wa, size_t nwa,
+    deci_UWORD *wb, size_t nwb,
+    deci_UWORD *out)
+{
+    size_t nchunks = nwa / nwb + !!(nwa % nwb);
+    size_t nchunk = nwa / nchunks + !!(nwa % nchunks);
+
+    // The first partial product goes directly to 'out'. Each next one overlaps the previous one in
+    // 'nwb' words, which are added; the rest is copied, so 'out' does not need to be zeroed.
+    fancy_mul(wa, nchunk, wb, nwb, out);
+
+    deci_UWORD *tmp = scratch_push(uu_mul_zu_or_saturate(nchunk + nwb, sizeof(deci_UWORD)));
+    for (size_t off = nchunk; off < nwa; off += nchunk) {
+        size_t n = nwa - off < nchunk ? nwa - off : nchunk;
+        fancy_mul(wa + off, n, wb, nwb, tmp);
+        deci_memcpy(out + off + nwb, tmp + nwb, n);
+        bool carry = kernels.add(out + off, out + off + nwb + n, tmp, tmp + nwb);
+        (void) carry;
+        assert(!carry);
+    }
+    scratch_pop(tmp);
+}
+
+// Karatsuba squaring: with 'a = a1 * B^h + a0', '2 * a0 * a1 = a0^2 + a1^2 - (a0 - a1)^2', so three
+// squares of half the size are needed.
+static void kara_sqr(deci_UWORD *wa, size_t n, deci_UWORD *out)
+{
+    size_t h = n - n / 2;
+    size_t nhi = n - h;
+    deci_UWORD *lo = wa;
+    deci_UWORD *hi = wa + h;
+
+    fancy_sqr(lo, h, out);
+    fancy_sqr(hi, nhi, out + 2 * h);
+
+    deci_UWORD *d = scratch_push(uu_mul_zu_or_saturate(5 * h + 1, sizeof(deci_UWORD)));
+    deci_UWORD *d2 = d + h;
+    deci_UWORD *mid = d2 + 2 * h;
+
+    // 'd = |a0 - a1|', 'd2 = d^2'.
+    deci_memcpy(d, lo, h);
+    if (kernels.sub_raw(d, d + h, hi, hi + nhi))
+        deci_uncomplement(d, d + h);
+    size_t nd = deci_normalize_n(d, h);
+    if (nd) {
+        fancy_sqr(d, nd, d2);
+        deci_zero_out_n(d2 + 2 * nd, 2 * (h - nd));
+    } else {
+        deci_zero_out_n(d2, 2 * h);
+    }
+
+    // 'mid = a0^2 + a1^2 - d^2'.
+    deci_memcpy(mid, out, 2 * h);
+    mid[2 * h] = 0;
+    (void) kernels.add(mid, mid + 2 * h + 1, out + 2 * h, out + 2 * n);
+    (void) kernels.sub_raw(mid, mid + 2 * h + 1, d2, d2 + 2 * h);
+
+    size_t nmid = deci_normalize_n(mid, 2 * h + 1);
+    if (nmid)
+        (void) kernels.add(out + h, out + 2 * n, mid, mid + nmid);
+
+    scratch_pop(d);
+}
+
+void fancy_sqr(deci_UWORD *wa, size_t nwa, deci_UWORD *out)
+{
+    if (nwa >= cutoffs.mul_parallel && tpool_nworkers() && parallel_mul(wa, nwa, wa, nwa, out))
+        return;
+
+    if (nwa < cutoffs.mul_basecase) {
+        kernels.sqr(wa, nwa, out);
+    } else if (nwa < cutoffs.mul_karatsuba) {
+        kara_sqr(wa, nwa, out);
+    } else if (nwa < cutoffs.mul_toom3) {
+        toom3_mul(wa, nwa, wa, nwa, out);
+    } else {
+        size_t nbytes = decintt_sqr_nscratch_bytes(nwa);
+        void *scratch = scratch_push(nbytes);
+        decintt_sqr(wa, nwa, out, scratch);
+        scratch_pop(scratch);
+    }
+}
+
 void fancy_mul(
     deci_UWORD *wa, size_t nwa,
     deci_UWORD *wb, size_t nwb,
     deci_UWORD *out)
 {
+    if (wa == wb && nwa == nwb) {
+        fancy_sqr(wa, nwa, out);
+        return;
+    }
+
     size_t min_n = nwa < nwb ? nwa : nwb;
-    if (min_n < MUL_BASECASE_CUTOFF) {
-        deci_zero_out_n(out, nwa + nwb);
-        deci_mul(wa, wa + nwa, wb, wb + nwb, out);
-    } else if (min_n < MUL_KARATSUBA_CUTOFF) {
-        size_t nscratch = decikara_nscratch(nwa, nwb, MUL_BASECASE_CUTOFF);
-        deci_UWORD *scratch = uu_xmalloc(sizeof(deci_UWORD), nscratch);
-        decikara_mul(wa, nwa, wb, nwb, scratch, out, MUL_BASECASE_CUTOFF);
-        free(scratch);
+    size_t max_n = nwa < nwb ? nwb : nwa;
+    bool unbalanced = max_n / 2 >= min_n;
+
+    if (!unbalanced && min_n >= cutoffs.mul_parallel && tpool_nworkers() &&
+        parallel_mul(wa, nwa, wb, nwb, out))
+    {
+        return;
+    }
+
+    if (min_n >= cutoffs.mul_karatsuba && unbalanced) {
+        // Above the Karatsuba tier, the cost of a product is driven by the longer operand.
+        if (nwa < nwb)
+            unbalanced_mul(wb, nwb, wa, nwa, out);
+        else
+            unbalanced_mul(wa, nwa, wb, nwb, out);
+    } else if (min_n < cutoffs.mul_basecase) {
+        kernels.mul(wa, nwa, wb, nwb, out);
+    } else if (min_n < cutoffs.mul_karatsuba) {
+        size_t nscratch = decikara_nscratch(nwa, nwb, cutoffs.mul_basecase);
+        deci_UWORD *scratch = scratch_push(uu_mul_zu_or_saturate(nscratch, sizeof(deci_UWORD)));
+        decikara_mul(wa, nwa, wb, nwb, scratch, out, cutoffs.mul_basecase);
+        scratch_pop(scratch);
+    } else if (min_n < cutoffs.mul_toom3) {
+        toom3_mul(wa, nwa, wb, nwb, out);
     } else {
-        if (wa == wb && nwa == nwb) {
-            size_t nbytes = decintt_sqr_nscratch_bytes(nwa);
-            void *scratch = uu_xmalloc(1, nbytes);
-            decintt_sqr(wa, nwa, out, scratch);
-            free(scratch);
-        } else {
-            size_t nbytes = decintt_mul_nscratch_bytes(nwa, nwb);
-            void *scratch = uu_xmalloc(1, nbytes);
-            decintt_mul(wa, nwa, wb, nwb, out, scratch);
-            free(scratch);
-        }
+        size_t nbytes = decintt_mul_nscratch_bytes(nwa, nwb);
+        void *scratch = scratch_push(nbytes);
+        decintt_mul(wa, nwa, wb, nwb, out, scratch);
+        scratch_pop(scratch);
     }
 }
 
+static inline deci_UWORD *scratch_dup(deci_UWORD *w, size_t n)
+{
+    deci_UWORD *r = scratch_push(n * sizeof(deci_UWORD));
+    deci_memcpy(r, w, n);
+    return r;
+}
+
 static int mul_callback(
         void *userdata,
         deci_UWORD *wa, size_t nwa,
@@ -51,13 +1120,13 @@ static int mul_callback(
     (void) userdata;
 
     if (out == wa) {
-        deci_UWORD *wa_copy = uu_xmemdup(wa, nwa * sizeof(deci_UWORD));
+        deci_UWORD *wa_copy = scratch_dup(wa, nwa);
         fancy_mul(wa_copy, nwa, wb, nwb, out);
-        free(wa_copy);
+        scratch_pop(wa_copy);
     } else if (out == wb) {
-        deci_UWORD *wb_copy = uu_xmemdup(wb, nwb * sizeof(deci_UWORD));
+        deci_UWORD *wb_copy = scratch_dup(wb, nwb);
         fancy_mul(wa, nwa, wb_copy, nwb, out);
-        free(wb_copy);
+        scratch_pop(wb_copy);
     } else {
         fancy_mul(wa, nwa, wb, nwb, out);
     }
@@ -65,6 +1134,121 @@ static int mul_callback(
     return 0;
 }
 
+// Burnikel-Ziegler division (in the form of Algorithm 1.9 "RecursiveDivRem" from "Modern Computer
+// Arithmetic" by Brent and Zimmermann).
+//
+// Divides the '(n + m)'-word 'a' by the 'n'-word 'b', where 'm <= n', the top word of 'b' is at
+// least 'DECI_BASE / 2', and 'a < b * DECI_BASE^m'. Writes the 'm'-word quotient into 'q'; the
+// remainder is left in 'a[0 ... n - 1]', and the rest of 'a' is zeroed.
+static void bz_divrem(deci_UWORD *a, size_t n, size_t m, deci_UWORD *b, deci_UWORD *q);
+
+// Same as 'bz_divrem()' for the top halves of a division step, where 'a < b * DECI_BASE^m' may
+// not hold: the dividend can exceed it by less than 'DECI_BASE^m'. If it does, the quotient is
+// taken to be 'DECI_BASE^m - 1', which is at most two too large, and 'a' is left with the
+// (non-negative) value of 'a - q * b'; the caller's correction steps bring it into range.
+static void bz_divrem_top(deci_UWORD *a, size_t n, size_t m, deci_UWORD *b, deci_UWORD *q)
+{
+    size_t i = n;
+    while (i && a[m + i - 1] == b[i - 1])
+        --i;
+    if (i && a[m + i - 1] < b[i - 1]) {
+        bz_divrem(a, n, m, b, q);
+        return;
+    }
+    for (size_t j = 0; j < m; ++j)
+        q[j] = DECI_BASE - 1;
+    // 'a -= (DECI_BASE^m - 1) * b'; the top 'n' words of 'a' are at least 'b'.
+    (void) kernels.sub_raw(a + m, a + n + m, b, b + n);
+    (void) kernels.add(a, a + n + m, b, b + n);
+}
+
+static void bz_divrem(deci_UWORD *a, size_t n, size_t m, deci_UWORD *b, deci_UWORD *q)
+{
+    if (m < cutoffs.div_basecase) {
+        deci_UWORD *t = scratch_dup(a, n + m);
+        size_t nq = deci_div(t, t + n + m, b, b + n);
+        if (nq > m)
+            nq = m;
+        nq = deci_normalize_n(t, nq);
+        deci_memcpy(q, t, nq);
+        deci_zero_out_n(q + nq, m - nq);
+        if (nq) {
+            fancy_mul(q, nq, b, n, t);
+            (void) kernels.sub_raw(a, a + n + m, t, t + nq + n);
+        }
+        scratch_pop(t);
+        return;
+    }
+
+    static deci_UWORD one = 1;
+
+    size_t k = m / 2;
+    deci_UWORD *t = scratch_push(uu_mul_zu_or_saturate(m, sizeof(deci_UWORD)));
+
+    // Divide the top '(n - k) + (m - k)' words of 'a' by the top 'n - k' words of 'b', then
+    // subtract the high part of the quotient times the low 'k' words of 'b', correcting the
+    // quotient while the result is negative.
+    bz_divrem_top(a + 2 * k, n - k, m - k, b + k, q + k);
+    fancy_mul(q + k, m - k, b, k, t);
+    bool neg = kernels.sub_raw(a + k, a + n + m, t, t + m);
+    while (neg) {
+        (void) kernels.sub_raw(q + k, q + m, &one, &one + 1);
+        neg = !kernels.add(a + k, a + n + m, b, b + n);
+    }
+
+    // Same for the low part of the quotient.
+    bz_divrem_top(a + k, n - k, k, b + k, q);
+    fancy_mul(q, k, b, k, t);
+    neg = kernels.sub_raw(a, a + n + m, t, t + 2 * k);
+    while (neg) {
+        (void) kernels.sub_raw(q, q + k, &one, &one + 1);
+        neg = !kernels.add(a, a + n + m, b, b + n);
+    }
+
+    scratch_pop(t);
+}
+
+// Divides 'wa' by 'wb' with 'bz_divrem()', where 'nwa >= nwb'. If 'quotient' is true, writes the
+// quotient into 'wa[0 ... nwa - nwb]', otherwise writes the remainder into 'wa[0 ... nwb - 1]'.
+static void bz_div(deci_UWORD *wa, size_t nwa, deci_UWORD *wb, size_t nwb, bool quotient)
+{
+    size_t n = nwb;
+    // The extra zero word on top makes the first window's top 'n' words less than 'b'.
+    size_t na = nwa + 2;
+    size_t nq = na - n;
+
+    deci_UWORD *b = scratch_push(uu_mul_zu_or_saturate(n + na + nq, sizeof(deci_UWORD)));
+    deci_UWORD *a = b + n;
+    deci_UWORD *q = a + na;
+
+    // Normalize so that the top word of the divisor is at least 'DECI_BASE / 2'.
+    deci_UWORD d = DECI_BASE / (wb[n - 1] + 1);
+    deci_memcpy(b, wb, n);
+    (void) deci_mul_uword(b, b + n, d);
+    deci_memcpy(a, wa, nwa);
+    a[nwa] = deci_mul_uword(a, a + nwa, d);
+    a[nwa + 1] = 0;
+
+    // Long division with 'n'-word digits, from the top: each step leaves the remainder in the
+    // top 'n' words of the next window.
+    for (size_t pos = nq; pos;) {
+        size_t m = pos < n ? pos : n;
+        pos -= m;
+        bz_divrem(a + pos, n, m, b, q + pos);
+    }
+
+    if (quotient) {
+        deci_memcpy(wa, q, nwa - nwb + 1);
+    } else {
+        deci_UWORD r = deci_divmod_uword(a, a + n, d);
+        (void) r;
+        assert(r == 0);
+        deci_memcpy(wa, a, n);
+    }
+
+    scratch_pop(b);
+}
+
 static inline size_t quotient_or_remainder(
         deci_UWORD *wa, size_t nwa,
         deci_UWORD *wb, size_t nwb,
@@ -78,13 +1262,16 @@ static inline size_t quotient_or_remainder(
 
     size_t ndelta = nwa - nwb + 1;
     size_t min_n = ndelta < nwb ? ndelta : nwb;
-    if (min_n < DIV_BASECASE_CUTOFF)
+    if (min_n < cutoffs.div_basecase)
         goto basecase;
 
-    if (nwb < DECINEWT_MIN)
-        goto basecase;
+    if (min_n < cutoffs.div_bz || nwb < DECINEWT_MIN) {
+        bz_div(wa, nwa, wb, nwb, quotient);
+        return quotient ? ndelta : nwb;
+    }
+
     size_t nscratch = decinewt_div_nscratch(nwa, nwb);
-    deci_UWORD *scratch = uu_xmalloc(sizeof(deci_UWORD), nscratch);
+    deci_UWORD *scratch = scratch_push(uu_mul_zu_or_saturate(nscratch, sizeof(deci_UWORD)));
     int r = decinewt_div(wa, nwa, wb, nwb, scratch, NULL, mul_callback);
     if (UU_UNLIKELY(r < 0)) {
         UU_PANIC("unexpected failure in decinewt_div");
@@ -94,10 +1281,10 @@ static inline size_t quotient_or_remainder(
         deci_memcpy(wa, scratch + nwa + 1, ndelta);
         retval = ndelta;
     } else {
-        (void) deci_sub_raw(wa, wa + nwa, scratch, scratch + nwa);
+        (void) kernels.sub_raw(wa, wa + nwa, scratch, scratch + nwa);
         retval = nwa;
     }
-    free(scratch);
+    scratch_pop(scratch);
     return retval;
 
 basecase:
@@ -6,11 +6,71 @@
 #include "common.h"
 #include "libdeci/deci.h"
 
+// Operand sizes, in words, at which the kernels switch to the next algorithm. Multiplication
+// uses the basecase below 'mul_basecase', then Karatsuba, then Toom-3 from 'mul_karatsuba' on, and
+// NTT from 'mul_toom3' on; the size that matters is that of the shorter operand. From
+// 'mul_parallel' on, if worker threads are enabled, balanced products are split with Karatsuba into
+// sub-products computed in parallel. Division looks at the shorter of the divisor and the quotient:
+// it uses the basecase below 'div_basecase', then Burnikel-Ziegler, then Newton's iteration from
+// 'div_bz' on. The gcd in 'number.c' switches from Lehmer's algorithm to a half-gcd for operands of
+// at least 'gcd_half' words.
+typedef struct {
+    size_t mul_basecase;
+    size_t mul_karatsuba;
+    size_t mul_toom3;
+    size_t mul_parallel;
+
+    size_t div_basecase;
+    size_t div_bz;
+
+    size_t gcd_half;
+} FancyCutoffs;
+
+// Toom-3 only makes its sub-products shorter than its operands from this size on,
+// Burnikel-Ziegler only splits its quotient in two from this size on, and the half-gcd only
+// shortens its operands from this size on.
+enum {
+    FANCY_MUL_BASECASE_MIN = 4,
+    FANCY_DIV_BASECASE_MIN = 2,
+    FANCY_GCD_HALF_MIN = 3,
+};
+
+// Sets of word kernels, from the most portable to the fastest one; see 'fancy.c'.
+typedef enum {
+    FANCY_KERNELS_SCALAR,
+    FANCY_KERNELS_AVX2,
+    FANCY_KERNELS_AVX512,
+} FancyKernels;
+
+// Statistics of the scratch arena of the calling thread.
+typedef struct {
+    // Bytes of scratch space currently borrowed by the kernels, and the maximum ever.
+    size_t cur_bytes;
+    size_t peak_bytes;
+    // Number of scratch blocks allocated from the system so far.
+    size_t nblocks;
+} FancyScratchStats;
+
+// Same as 'deci_add()' and 'deci_sub_raw()', but dispatched to the current kernels.
+bool fancy_add(deci_UWORD *wa, deci_UWORD *wa_end, deci_UWORD *wb, deci_UWORD *wb_end);
+
+bool fancy_sub_raw(deci_UWORD *wa, deci_UWORD *wa_end, deci_UWORD *wb, deci_UWORD *wb_end);
+
+// Writes 'x * wa - y * wb' into 'out', which has 'max(nwa, nwb) + 1' words and must not overlap
+// the operands. Requires 'x, y < 2^(w-2)' for 'w'-bit words, and the result to be non-negative.
+void fancy_lincomb(
+        deci_UWORD *wa, size_t nwa, deci_UWORD x,
+        deci_UWORD *wb, size_t nwb, deci_UWORD y,
+        deci_UWORD *out);
+
 void fancy_mul(
     deci_UWORD *wa, size_t nwa,
     deci_UWORD *wb, size_t nwb,
     deci_UWORD *out);
 
+// Same as 'fancy_mul(wa, nwa, wa, nwa, out)'.
+void fancy_sqr(deci_UWORD *wa, size_t nwa, deci_UWORD *out);
+
 size_t fancy_div(
     deci_UWORD *wa, size_t nwa,
     deci_UWORD *wb, size_t nwb);
@@ -18,3 +78,45 @@ size_t fancy_div(
 size_t fancy_mod(
     deci_UWORD *wa, size_t nwa,
     deci_UWORD *wb, size_t nwb);
+
+FancyScratchStats fancy_scratch_stats(void);
+
+FancyCutoffs fancy_get_cutoffs(void);
+
+void fancy_set_cutoffs(FancyCutoffs c);
+
+// Parses a whitespace- or comma-separated list of 'name=value' pairs, where 'name' is the name of
+// a 'FancyCutoffs' field, into 'c', leaving the fields not mentioned intact.
+//
+// Returns false if the syntax is invalid, or if 'mul_basecase', 'div_basecase' or 'gcd_half' ends
+// up smaller than 'FANCY_MUL_BASECASE_MIN', 'FANCY_DIV_BASECASE_MIN' or 'FANCY_GCD_HALF_MIN',
+// respectively; 'c' may have been partially modified in that case.
+bool fancy_cutoffs_parse(FancyCutoffs *c, const char *s);
+
+// Reads cutoffs, in the format of 'fancy_cutoffs_parse()', from the file 'path', as written by
+// 'calx-tune'; '#' starts a comment that extends to the end of the line.
+//
+// Returns false, with 'errno' set, if the file cannot be read or is invalid; 'c' is left intact in
+// that case.
+bool fancy_cutoffs_load(FancyCutoffs *c, const char *path);
+
+// Sets the number of threads the kernels may use, including the calling one; 1 disables
+// parallelism. Must not be called while a kernel is running.
+//
+// Returns false if no worker thread could be started.
+bool fancy_set_nthreads(size_t n);
+
+// Returns the fastest kernels the CPU supports.
+FancyKernels fancy_detect_kernels(void);
+
+FancyKernels fancy_get_kernels(void);
+
+// Switches to the kernels 'k'. Must not be called while a kernel is running.
+//
+// Returns false if the CPU does not support them.
+bool fancy_set_kernels(FancyKernels k);
+
+const char *fancy_kernels_name(FancyKernels k);
+
+// Parses the name of a set of kernels, as returned by 'fancy_kernels_name()', into 'k'.
+bool fancy_kernels_parse(FancyKernels *k, const char *s);
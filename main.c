@@ -11,6 +11,7 @@
 #include "str.h"
 #include "list.h"
 #include "number.h"
+#include "fancy.h"
 #include "text_manip.h"
 #include "prompt.h"
 
@@ -218,6 +219,24 @@ static size_t guard_magnitude(State *state, Number *x)
     return r;
 }
 
+// Borrows (takes regular references to):
+//   * 'x'.
+static size_t guard_root_degree(State *state, Number *x)
+{
+    size_t r = number_to_zu(x);
+    if (UU_UNLIKELY(r == 0 || r == SIZE_MAX))
+        state_throw(state, "invalid root degree");
+    return r;
+}
+
+static Number *guard_int(State *state, Value *args, size_t i)
+{
+    Number *x = (Number *) guardv(state, args, i, VK_NUM);
+    if (UU_UNLIKELY(!number_is_fzero(x)))
+        state_throw(state, "argument #%zu: expected integer", i + 1);
+    return x;
+}
+
 static Value X_Dasm(State *state, Value *args, uint32_t nargs)
 {
     guardn(state, nargs, 1);
@@ -394,11 +413,8 @@ static Value X_Where(State *state, Value *args, uint32_t nargs)
     return mk_nil();
 }
 
-static Value X_Random32(State *state, Value *args, uint32_t nargs)
+static uint32_t random_u32(State *state)
 {
-    guardn(state, nargs, 0);
-    (void) args;
-
     enum { NBUF = 128 };
     static const char *RAND_PATH = "/dev/urandom";
 
@@ -419,7 +435,15 @@ static Value X_Random32(State *state, Value *args, uint32_t nargs)
             state_throw(state, "truncated or failed read from random device");
         buf_ptr = buf;
     }
-    return (Value) number_new_from_zu(*buf_ptr++);
+    return *buf_ptr++;
+}
+
+static Value X_Random32(State *state, Value *args, uint32_t nargs)
+{
+    guardn(state, nargs, 0);
+    (void) args;
+
+    return (Value) number_new_from_zu(random_u32(state));
 }
 
 static Value X_Trunc(State *state, Value *args, uint32_t nargs)
@@ -665,6 +689,312 @@ static Value X_UpScale(State *state, Value *args, uint32_t nargs)
     return (Value) number_scale_up(x, mag);
 }
 
+static Value X_ModPow(State *state, Value *args, uint32_t nargs)
+{
+    guardn(state, nargs, 3);
+    Number *b = guard_int(state, args, 0);
+    Number *e = guard_int(state, args, 1);
+    Number *m = guard_int(state, args, 2);
+
+    if (e->sign && !number_is_zero(e))
+        state_throw(state, "exponent is negative");
+    if (m->sign || number_is_zero(m))
+        state_throw(state, "modulus is not positive");
+
+    value_ref((Value) b);
+    value_ref((Value) e);
+    value_ref((Value) m);
+    return (Value) number_mod_pow(b, e, m);
+}
+
+static Value X_Gcd(State *state, Value *args, uint32_t nargs)
+{
+    guardn(state, nargs, 2);
+    Number *a = guard_int(state, args, 0);
+    Number *b = guard_int(state, args, 1);
+
+    value_ref((Value) a);
+    value_ref((Value) b);
+    return (Value) number_gcd(a, b);
+}
+
+static Value X_ExtGcd(State *state, Value *args, uint32_t nargs)
+{
+    guardn(state, nargs, 2);
+    Number *a = guard_int(state, args, 0);
+    Number *b = guard_int(state, args, 1);
+
+    value_ref((Value) a);
+    value_ref((Value) b);
+    Value r[3];
+    Number *x;
+    Number *y;
+    r[0] = (Value) number_ext_gcd(a, b, &x, &y);
+    r[1] = (Value) x;
+    r[2] = (Value) y;
+    return (Value) list_new_steal(r, 3);
+}
+
+static Value X_ModInverse(State *state, Value *args, uint32_t nargs)
+{
+    guardn(state, nargs, 2);
+    Number *a = guard_int(state, args, 0);
+    Number *m = guard_int(state, args, 1);
+
+    if (m->sign || number_is_zero(m))
+        state_throw(state, "modulus is not positive");
+
+    value_ref((Value) a);
+    value_ref((Value) m);
+    Number *r = number_mod_inverse(a, m);
+    if (!r)
+        state_throw(state, "not invertible");
+    return (Value) r;
+}
+
+static Value X_Isqrt(State *state, Value *args, uint32_t nargs)
+{
+    guardn(state, nargs, 1);
+    Number *x = guard_int(state, args, 0);
+
+    if (x->sign && !number_is_zero(x))
+        state_throw(state, "argument is negative");
+
+    value_ref((Value) x);
+    return (Value) number_iroot(x, 2);
+}
+
+static Value X_Iroot(State *state, Value *args, uint32_t nargs)
+{
+    guardn(state, nargs, 2);
+    Number *x = guard_int(state, args, 0);
+    Number *n = guard_int(state, args, 1);
+
+    size_t deg = guard_root_degree(state, n);
+    if (x->sign && !number_is_zero(x) && deg % 2 == 0)
+        state_throw(state, "cannot take even root of negative value");
+
+    value_ref((Value) x);
+    return (Value) number_iroot(x, deg);
+}
+
+static Value X_Sqrt(State *state, Value *args, uint32_t nargs)
+{
+    guardn(state, nargs, 1);
+    Number *x = (Number *) guardv(state, args, 0, VK_NUM);
+
+    if (x->sign && !number_is_zero(x))
+        state_throw(state, "argument is negative");
+
+    value_ref((Value) x);
+    return (Value) number_root(x, 2, state_get_ntp(state));
+}
+
+static Value X_IsProbablePrime(State *state, Value *args, uint32_t nargs)
+{
+    guardn(state, nargs, 2);
+    Number *x = guard_int(state, args, 0);
+    Number *n = guard_int(state, args, 1);
+
+    size_t nrounds = number_to_zu(n);
+    if (UU_UNLIKELY(nrounds == SIZE_MAX)) {
+        if (n->sign && !number_is_zero(n))
+            state_throw(state, "number of rounds is negative");
+        else
+            state_throw(state, "number of rounds is too big");
+    }
+
+    uint64_t seed = (((uint64_t) random_u32(state)) << 32) | random_u32(state);
+    return mk_flag(number_is_probable_prime(x, nrounds, seed));
+}
+
+static Value X_Factorize(State *state, Value *args, uint32_t nargs)
+{
+    guardn(state, nargs, 1);
+    Number *x = guard_int(state, args, 0);
+
+    if (x->sign || number_is_zero(x))
+        state_throw(state, "argument is not positive");
+
+    value_ref((Value) x);
+    size_t nfactors;
+    Number **factors = number_factorize(x, &nfactors);
+    Value *data = uu_xmalloc(nfactors, sizeof(Value));
+    for (size_t i = 0; i < nfactors; ++i)
+        data[i] = (Value) factors[i];
+    free(factors);
+    List *r = list_new_steal(data, nfactors);
+    free(data);
+    return (Value) r;
+}
+
+static Value X_SmallestFactor(State *state, Value *args, uint32_t nargs)
+{
+    guardn(state, nargs, 1);
+    Number *x = guard_int(state, args, 0);
+
+    if (x->sign || number_is_zero(x))
+        state_throw(state, "argument is not positive");
+
+    value_ref((Value) x);
+    return (Value) number_smallest_prime_factor(x);
+}
+
+static Value X_Fact(State *state, Value *args, uint32_t nargs)
+{
+    guardn(state, nargs, 1);
+    Number *n = guard_int(state, args, 0);
+
+    size_t x = number_to_zu(n);
+    if (UU_UNLIKELY(x == SIZE_MAX)) {
+        if (n->sign && !number_is_zero(n))
+            state_throw(state, "argument is negative");
+        else
+            state_throw(state, "argument is too big");
+    }
+    return (Value) number_factorial(x);
+}
+
+static Value X_Choice(State *state, Value *args, uint32_t nargs)
+{
+    guardn(state, nargs, 2);
+    Number *n = guard_int(state, args, 0);
+    Number *k = guard_int(state, args, 1);
+
+    if ((n->sign && !number_is_zero(n)) || (k->sign && !number_is_zero(k)))
+        state_throw(state, "argument is negative");
+    if (number_compare(k, n) == COMPARE_GREATER)
+        return (Value) number_new_from_zu(0);
+
+    size_t x = number_to_zu(k);
+    if (x == SIZE_MAX) {
+        // 'C(n, k) = C(n, n - k)'.
+        value_ref((Value) n);
+        value_ref((Value) k);
+        Number *nk = number_sub(n, k);
+        x = number_to_zu(nk);
+        value_unref((Value) nk);
+        if (x == SIZE_MAX)
+            state_throw(state, "argument is too big");
+    }
+    value_ref((Value) n);
+    return (Value) number_choice(n, x);
+}
+
+static Value X_Product(State *state, Value *args, uint32_t nargs)
+{
+    guardn(state, nargs, 1);
+    List *list = (List *) guardv(state, args, 0, VK_LIST);
+
+    size_t n = list->size;
+    for (size_t i = 0; i < n; ++i)
+        if (UU_UNLIKELY(list->data[i]->kind != VK_NUM))
+            state_throw(
+                state, "element #%zu: expected %s, got %s",
+                i + 1, value_kind_name_long(VK_NUM), value_kind_name_long(list->data[i]->kind));
+
+    Number **xs = uu_xmalloc(n, sizeof(Number *));
+    for (size_t i = 0; i < n; ++i) {
+        value_ref(list->data[i]);
+        xs[i] = (Number *) list->data[i];
+    }
+    Number *r = number_product(xs, n);
+    free(xs);
+    return (Value) r;
+}
+
+static Value X_Pi(State *state, Value *args, uint32_t nargs)
+{
+    guardn(state, nargs, 0);
+    (void) args;
+
+    return state_get_const(state, STATE_CONST_PI, state_get_ntp(state));
+}
+
+static Value X_E(State *state, Value *args, uint32_t nargs)
+{
+    guardn(state, nargs, 0);
+    (void) args;
+
+    return state_get_const(state, STATE_CONST_E, state_get_ntp(state));
+}
+
+static Value X_Ln2(State *state, Value *args, uint32_t nargs)
+{
+    guardn(state, nargs, 0);
+    (void) args;
+
+    return state_get_const(state, STATE_CONST_LN2, state_get_ntp(state));
+}
+
+static Value X_Exp(State *state, Value *args, uint32_t nargs)
+{
+    guardn(state, nargs, 1);
+    Number *x = (Number *) guardv(state, args, 0, VK_NUM);
+
+    value_ref((Value) x);
+    return (Value) number_exp(x, state_get_ntp(state));
+}
+
+static Value X_Ln(State *state, Value *args, uint32_t nargs)
+{
+    guardn(state, nargs, 1);
+    Number *x = (Number *) guardv(state, args, 0, VK_NUM);
+
+    if (x->sign || number_is_zero(x))
+        state_throw(state, "argument is not positive");
+
+    value_ref((Value) x);
+    return (Value) number_ln(x, state, state_get_ntp(state));
+}
+
+static Value X_Sin(State *state, Value *args, uint32_t nargs)
+{
+    guardn(state, nargs, 1);
+    Number *x = (Number *) guardv(state, args, 0, VK_NUM);
+
+    value_ref((Value) x);
+    return (Value) number_sin(x, state, state_get_ntp(state));
+}
+
+static Value X_Cos(State *state, Value *args, uint32_t nargs)
+{
+    guardn(state, nargs, 1);
+    Number *x = (Number *) guardv(state, args, 0, VK_NUM);
+
+    value_ref((Value) x);
+    return (Value) number_cos(x, state, state_get_ntp(state));
+}
+
+static Value X_Tan(State *state, Value *args, uint32_t nargs)
+{
+    guardn(state, nargs, 1);
+    Number *x = (Number *) guardv(state, args, 0, VK_NUM);
+
+    value_ref((Value) x);
+    return (Value) number_tan(x, state, state_get_ntp(state));
+}
+
+static Value X_Atan(State *state, Value *args, uint32_t nargs)
+{
+    guardn(state, nargs, 1);
+    Number *x = (Number *) guardv(state, args, 0, VK_NUM);
+
+    value_ref((Value) x);
+    return (Value) number_atan(x, state, state_get_ntp(state));
+}
+
+static Value X_Atan2(State *state, Value *args, uint32_t nargs)
+{
+    guardn(state, nargs, 2);
+    Number *y = (Number *) guardv(state, args, 0, VK_NUM);
+    Number *x = (Number *) guardv(state, args, 1, VK_NUM);
+
+    value_ref((Value) y);
+    value_ref((Value) x);
+    return (Value) number_atan2(y, x, state, state_get_ntp(state));
+}
+
 static Value X_Wref(State *state, Value *args, uint32_t nargs)
 {
     guardn(state, nargs, 1);
@@ -698,10 +1028,65 @@ static void init_globals(void)
 
     if ((s = getenv("CALX_PATH")) && s[0] != '\0')
         calx_path = uu_xstrdup(s);
+
+    // The cutoffs measured by 'calx-tune', if any, then the ones from 'CALX_CUTOFFS' on top.
+    FancyCutoffs c = fancy_get_cutoffs();
+    if ((s = getenv("CALX_CUTOFFS_FILE")) && s[0] != '\0') {
+        if (!fancy_cutoffs_load(&c, s))
+            fprintf(stderr, "Warning: cannot load cutoffs from '%s': %s.\n", s, strerror(errno));
+    } else if (calx_path) {
+        char *path = uu_xstrf("%s/cutoffs", calx_path);
+        if (!fancy_cutoffs_load(&c, path) && errno != ENOENT)
+            fprintf(stderr, "Warning: cannot load cutoffs from '%s': %s.\n", path, strerror(errno));
+        free(path);
+    }
+    if ((s = getenv("CALX_CUTOFFS"))) {
+        FancyCutoffs o = c;
+        if (fancy_cutoffs_parse(&o, s))
+            c = o;
+        else
+            fprintf(stderr, "Warning: ignoring invalid CALX_CUTOFFS value.\n");
+    }
+    fancy_set_cutoffs(c);
+
+    FancyKernels k = fancy_detect_kernels();
+    if ((s = getenv("CALX_KERNELS")) && s[0] != '\0') {
+        FancyKernels forced;
+        if (!fancy_kernels_parse(&forced, s))
+            fprintf(stderr, "Warning: ignoring invalid CALX_KERNELS value.\n");
+        else if (forced > k)
+            fprintf(stderr, "Warning: CALX_KERNELS: '%s' is not supported by this CPU.\n", s);
+        else
+            k = forced;
+    }
+    fancy_set_kernels(k);
+
+    if ((s = getenv("CALX_THREADS")) && s[0] != '\0') {
+        char *endptr;
+        errno = 0;
+        long n = strtol(s, &endptr, 10);
+        if (errno || *endptr != '\0' || n < 0) {
+            fprintf(stderr, "Warning: ignoring invalid CALX_THREADS value.\n");
+        } else {
+            if (n == 0)
+                n = sysconf(_SC_NPROCESSORS_ONLN);
+            if (n > 1 && !fancy_set_nthreads(n))
+                fprintf(stderr, "Warning: cannot start worker threads.\n");
+        }
+    }
 }
 
 static void free_globals(void)
 {
+    if (debug_flag) {
+        FancyScratchStats stats = fancy_scratch_stats();
+        fprintf(
+            stderr, "--- scratch arena: peak %zu bytes, %zu block(s) allocated ---\n",
+            stats.peak_bytes, stats.nblocks);
+    }
+
+    fancy_set_nthreads(1);
+
     free(calx_path);
 }
 
@@ -754,6 +1139,29 @@ static State *make_state(void)
     state_steal_global(state, PAIR("NumDigits"), mk_cfunc(X_NumDigits));
     state_steal_global(state, PAIR("DownScale"), mk_cfunc(X_DownScale));
     state_steal_global(state, PAIR("UpScale"), mk_cfunc(X_UpScale));
+    state_steal_global(state, PAIR("ModPow"), mk_cfunc(X_ModPow));
+    state_steal_global(state, PAIR("gcd"), mk_cfunc(X_Gcd));
+    state_steal_global(state, PAIR("ExtGcd"), mk_cfunc(X_ExtGcd));
+    state_steal_global(state, PAIR("ModInverse"), mk_cfunc(X_ModInverse));
+    state_steal_global(state, PAIR("isqrt"), mk_cfunc(X_Isqrt));
+    state_steal_global(state, PAIR("iroot"), mk_cfunc(X_Iroot));
+    state_steal_global(state, PAIR("sqrt"), mk_cfunc(X_Sqrt));
+    state_steal_global(state, PAIR("IsProbablePrime"), mk_cfunc(X_IsProbablePrime));
+    state_steal_global(state, PAIR("Factorize"), mk_cfunc(X_Factorize));
+    state_steal_global(state, PAIR("SmallestFactor"), mk_cfunc(X_SmallestFactor));
+    state_steal_global(state, PAIR("fact"), mk_cfunc(X_Fact));
+    state_steal_global(state, PAIR("choice"), mk_cfunc(X_Choice));
+    state_steal_global(state, PAIR("Product"), mk_cfunc(X_Product));
+    state_steal_global(state, PAIR("Pi"), mk_cfunc(X_Pi));
+    state_steal_global(state, PAIR("E"), mk_cfunc(X_E));
+    state_steal_global(state, PAIR("Ln2"), mk_cfunc(X_Ln2));
+    state_steal_global(state, PAIR("exp"), mk_cfunc(X_Exp));
+    state_steal_global(state, PAIR("ln"), mk_cfunc(X_Ln));
+    state_steal_global(state, PAIR("sin"), mk_cfunc(X_Sin));
+    state_steal_global(state, PAIR("cos"), mk_cfunc(X_Cos));
+    state_steal_global(state, PAIR("tan"), mk_cfunc(X_Tan));
+    state_steal_global(state, PAIR("atan"), mk_cfunc(X_Atan));
+    state_steal_global(state, PAIR("atan2"), mk_cfunc(X_Atan2));
     state_steal_global(state, PAIR("Wref"), mk_cfunc(X_Wref));
     state_steal_global(state, PAIR("Wvalue"), mk_cfunc(X_Wvalue));
 #undef PAIR
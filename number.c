@@ -13,7 +13,83 @@
         (Y_) = swap_tmp_; \
     } while (0)
 
-static Number *unsafe_reallocate(Number *a, size_t nwords)
+// Storage pool for numbers.
+//
+// A number with at most '1 << (POOL_NCLASSES - 1)' words lives in a block carved out of a slab;
+// there is one free list per size class, and the capacity of a class-'k' block is '1 << k' words.
+// Larger numbers go straight to 'realloc()'. The class of a block is always
+// 'pool_class(a->nwords)', so 'unsafe_reallocate()' only has to move a number when its class
+// changes. Slabs are never returned to the system. Numbers are only allocated on the main thread;
+// kernel worker threads never touch the pool, so the free lists are plain process-wide globals.
+//
+// Building with 'CALX_NUMBER_POOL=0' puts every number in a 'realloc()'ed block of its own, so
+// that leak checkers can see leaked numbers.
+
+#ifndef CALX_NUMBER_POOL
+# define CALX_NUMBER_POOL 1
+#endif
+
+enum {
+    POOL_NCLASSES = 7,
+    POOL_SLAB_SIZE = 16 * 1024,
+};
+
+typedef struct PoolBlock {
+    struct PoolBlock *next;
+} PoolBlock;
+
+static PoolBlock *pool_free_lists[POOL_NCLASSES];
+
+// Returns the size class for 'nwords', or -1 if it is too large to be pooled.
+static inline int pool_class(size_t nwords)
+{
+    if (!CALX_NUMBER_POOL)
+        return -1;
+    if (nwords <= 1)
+        return 0;
+    if (nwords > (((size_t) 1) << (POOL_NCLASSES - 1)))
+        return -1;
+    return CHAR_BIT * sizeof(unsigned long) - __builtin_clzl(nwords - 1);
+}
+
+static inline size_t pool_block_size(int k)
+{
+    return sizeof(Number) + (((size_t) 1) << k) * sizeof(deci_UWORD);
+}
+
+static __attribute__((noinline))
+void pool_refill(int k)
+{
+    size_t nblock = pool_block_size(k);
+    size_t n = POOL_SLAB_SIZE / nblock;
+    char *slab = uu_xmalloc(n, nblock);
+
+    PoolBlock *head = pool_free_lists[k];
+    for (size_t i = n; i; --i) {
+        PoolBlock *b = (PoolBlock *) (slab + (i - 1) * nblock);
+        b->next = head;
+        head = b;
+    }
+    pool_free_lists[k] = head;
+}
+
+static inline Number *pool_alloc(int k)
+{
+    if (UU_UNLIKELY(!pool_free_lists[k]))
+        pool_refill(k);
+    PoolBlock *b = pool_free_lists[k];
+    pool_free_lists[k] = b->next;
+    return (Number *) b;
+}
+
+static inline void pool_free(Number *a, int k)
+{
+    PoolBlock *b = (PoolBlock *) a;
+    b->next = pool_free_lists[k];
+    pool_free_lists[k] = b;
+}
+
+static Number *raw_reallocate(Number *a, size_t nwords)
 {
     size_t n;
     if (UU_UNLIKELY(__builtin_mul_overflow(nwords, sizeof(deci_UWORD), &n)))
@@ -29,15 +105,51 @@ oom:
     UU_PANIC_OOM();
 }
 
+static Number *unsafe_reallocate(Number *a, size_t nwords)
+{
+    size_t nwa = a->nwords;
+    int old_k = pool_class(nwa);
+    int new_k = pool_class(nwords);
+
+    if (old_k == new_k) {
+        if (old_k < 0)
+            return raw_reallocate(a, nwords);
+        a->nwords = nwords;
+        return a;
+    }
+
+    Number *r = new_k < 0 ? raw_reallocate(NULL, nwords) : pool_alloc(new_k);
+    size_t ncopy = nwa < nwords ? nwa : nwords;
+    memcpy(r, a, sizeof(Number) + ncopy * sizeof(deci_UWORD));
+    r->nwords = nwords;
+
+    if (old_k < 0)
+        free(a);
+    else
+        pool_free(a, old_k);
+    return r;
+}
+
 static Number *allocate(char sign, size_t nwords, size_t scale)
 {
-    Number *a = unsafe_reallocate(NULL, nwords);
+    int k = pool_class(nwords);
+    Number *a = k < 0 ? raw_reallocate(NULL, nwords) : pool_alloc(k);
     a->gc_hdr = (GcHeader) {.nrefs = 1, .kind = VK_NUM};
     a->sign = sign;
+    a->nwords = nwords;
     a->scale = scale;
     return a;
 }
 
+void number_destroy(Number *a)
+{
+    int k = pool_class(a->nwords);
+    if (k < 0)
+        free(a);
+    else
+        pool_free(a, k);
+}
+
 static __attribute__((noinline))
 Number *unsafe_push_word(Number *a, deci_UWORD w)
 {
@@ -47,10 +159,66 @@ Number *unsafe_push_word(Number *a, deci_UWORD w)
     return a;
 }
 
+// Small non-negative integers are interned: the cache holds a reference to each entry, so an
+// entry never reaches 'nrefs == 1' while handed out, and 'mkuniq()' copies it before mutation.
+static Number *small_cache[NUMBER_SMALL_CACHE_SIZE];
+
+static inline Number *small_cached(deci_UWORD w)
+{
+    Number *a = small_cache[w];
+    if (UU_UNLIKELY(!a)) {
+        if (w) {
+            a = allocate(/*sign=*/0, /*nwords=*/1, /*scale=*/0);
+            a->words[0] = w;
+        } else {
+            a = allocate(/*sign=*/0, /*nwords=*/0, /*scale=*/0);
+        }
+        small_cache[w] = a;
+    }
+    value_ref((Value) a);
+    return a;
+}
+
+// Steals (takes move references to):
+//   * 'a';
+//   * 'b'.
+//
+// Returns an integer with sign 'sign' and absolute value 'w' ('w < DECI_BASE'), reusing the
+// storage of either 'a' or 'b' if it is a uniquely-referenced single-word integer.
+static Number *small_result(Number *a, Number *b, char sign, deci_UWORD w)
+{
+    if (!w) {
+        sign = 0;
+    } else if (a->gc_hdr.nrefs == 1 && a->nwords == 1 && a->scale == 0) {
+        a->sign = sign;
+        a->words[0] = w;
+        value_unref((Value) b);
+        return a;
+    } else if (b->gc_hdr.nrefs == 1 && b->nwords == 1 && b->scale == 0) {
+        b->sign = sign;
+        b->words[0] = w;
+        value_unref((Value) a);
+        return b;
+    }
+
+    value_unref((Value) a);
+    value_unref((Value) b);
+
+    if (!sign && w < NUMBER_SMALL_CACHE_SIZE)
+        return small_cached(w);
+
+    Number *r = allocate(/*sign=*/sign, /*nwords=*/1, /*scale=*/0);
+    r->words[0] = w;
+    return r;
+}
+
 Number *number_new_from_zu(size_t x)
 {
     enum { NBUF = 4 };
 
+    if (x < NUMBER_SMALL_CACHE_SIZE)
+        return small_cached(x);
+
     deci_UWORD buf[NBUF];
     size_t nwords = 0;
 
@@ -269,16 +437,145 @@ Number *number_parse(const char *s, const char *s_end)
     return parse_no_sq(s, s_end);
 }
 
-Number *number_parse_base(const char *s, const char *s_end, uint8_t base, NumberTruncateParams ntp)
+enum {
+    // Digit strings of up to this many words' worth of digits are converted with the quadratic
+    // method; longer ones are split in halves recursively.
+    PARSE_BASECASE_NWORDS = 32,
+
+    // Same for integers being converted to digit strings, in words of the integer.
+    TOSTRING_BASECASE_NWORDS = 32,
+};
+
+// Returns the maximum 'n' such that 'base ** n < DECI_BASE', and writes 'base ** n' to '*out_pow'.
+static inline size_t digits_per_word(uint8_t base, deci_UWORD *out_pow)
+{
+    size_t n = 0;
+    deci_DOUBLE_UWORD p = 1;
+    while (p * base < DECI_BASE) {
+        p *= base;
+        ++n;
+    }
+    *out_pow = p;
+    return n;
+}
+
+typedef struct {
+    uint8_t base;
+    // 'log2(base)' if 'base' is a power of two, zero otherwise.
+    int log2_base;
+    // Digits per word, and 'base ** dpw'.
+    size_t dpw;
+    deci_UWORD wpow;
+    // 'pows[k]' is 'base ** (dpw << k)'; grown on demand.
+    Number **pows;
+    size_t npows;
+} RadixPowers;
+
+static RadixPowers radix_powers_new(uint8_t base)
+{
+    RadixPowers rp = {.base = base, .log2_base = 0, .pows = NULL, .npows = 0};
+    rp.dpw = digits_per_word(base, &rp.wpow);
+    if (!(base & (base - 1)))
+        rp.log2_base = __builtin_ctz(base);
+    return rp;
+}
+
+// Returns a borrowed reference to 'base ** (dpw << k)'.
+static Number *radix_powers_get(RadixPowers *rp, size_t k)
+{
+    if (k >= rp->npows) {
+        rp->pows = uu_xrealloc(rp->pows, k + 1, sizeof(Number *));
+        for (size_t i = rp->npows; i <= k; ++i) {
+            if (i == 0) {
+                rp->pows[i] = number_new_from_zu(rp->wpow);
+            } else {
+                Number *prev = rp->pows[i - 1];
+                value_ref((Value) prev);
+                value_ref((Value) prev);
+                rp->pows[i] = number_mul(prev, prev);
+            }
+        }
+        rp->npows = k + 1;
+    }
+    return rp->pows[k];
+}
+
+static void radix_powers_destroy(RadixPowers *rp)
+{
+    for (size_t i = 0; i < rp->npows; ++i)
+        value_unref((Value) rp->pows[i]);
+    free(rp->pows);
+}
+
+// Converts digits 'd[0] ... d[n - 1]' (most significant first) into an integer, processing a
+// word's worth of digits per pass.
+static Number *parse_digits_basecase(RadixPowers *rp, const uint8_t *d, size_t n)
 {
-    Number *a = number_new_from_zu(0);
+    size_t dpw = rp->dpw;
+    Number *a = allocate(/*sign=*/0, /*nwords=*/n / dpw + 1, /*scale=*/0);
+    deci_UWORD *wa = a->words;
+    size_t nwa = 0;
+
+    size_t nchunk = n % dpw;
+    if (!nchunk)
+        nchunk = dpw;
+
+    for (const uint8_t *d_end = d + n; d != d_end; nchunk = dpw) {
+        deci_UWORD w = 0;
+        deci_UWORD mul = 1;
+        for (size_t i = 0; i < nchunk; ++i) {
+            w = w * rp->base + *d++;
+            mul *= rp->base;
+        }
+
+        deci_UWORD hi = deci_mul_uword(wa, wa + nwa, mul);
+        if (hi)
+            wa[nwa++] = hi;
+
+        if (!nwa) {
+            if (w)
+                wa[nwa++] = w;
+        } else if (deci_add(wa, wa + nwa, &w, &w + 1)) {
+            wa[nwa++] = 1;
+        }
+    }
+
+    return unsafe_reallocate(a, nwa);
+}
 
+// Same as 'parse_digits_basecase()', but subquadratic: the digit string is split so that the lower
+// part has 'dpw << k' digits, and the halves are combined with a single multiplication by a cached
+// power of the base.
+static Number *parse_digits(RadixPowers *rp, const uint8_t *d, size_t n)
+{
+    size_t dpw = rp->dpw;
+    if (n <= dpw * PARSE_BASECASE_NWORDS)
+        return parse_digits_basecase(rp, d, n);
+
+    size_t k = 0;
+    while ((dpw << (k + 1)) < n)
+        ++k;
+    size_t nlo = dpw << k;
+
+    Number *hi = parse_digits(rp, d, n - nlo);
+    Number *lo = parse_digits(rp, d + n - nlo, nlo);
+
+    Number *p = radix_powers_get(rp, k);
+    value_ref((Value) p);
+    return number_add(number_mul(hi, p), lo);
+}
+
+Number *number_parse_base(const char *s, const char *s_end, uint8_t base, NumberTruncateParams ntp)
+{
     bool negate = false;
     if (*s == '-') {
         negate = true;
         ++s;
     }
 
+    uint8_t *digits = uu_xmalloc(s_end - s, 1);
+    size_t ndigits = 0;
+
     // 'base_scale' is zero if no dot seen, otherwise the number of digits after the dot.
     size_t base_scale = 0;
     bool seen_dot = false;
@@ -293,12 +590,16 @@ Number *number_parse_base(const char *s, const char *s_end, uint8_t base, Number
         default:
             if (seen_dot)
                 ++base_scale;
-            a = number_mul_uword(a, base);
-            a = number_abs_add_uword(a, decode(c));
+            digits[ndigits++] = decode(c);
             break;
         }
     }
 
+    RadixPowers rp = radix_powers_new(base);
+    Number *a = parse_digits(&rp, digits, ndigits);
+    radix_powers_destroy(&rp);
+    free(digits);
+
     if (base_scale) {
         Number *divisor = number_pow_zu(
             number_new_from_zu(base),
@@ -466,42 +767,127 @@ size_t number_tostring_base_size(Number *a, uint8_t base, size_t nfrac)
             uu_mul_zu_or_saturate(a->nwords, dpw)));
 }
 
+static const char *RADIX_CHARS = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+// Writes the 'rp->dpw' lowest base-'rp->base' digits of 'x' into 't', least significant first.
+static inline char *emit_chunk_reversed(RadixPowers *rp, deci_UWORD x, char *t)
+{
+    size_t dpw = rp->dpw;
+    if (rp->log2_base) {
+        int shift = rp->log2_base;
+        deci_UWORD mask = rp->base - 1;
+        for (size_t i = 0; i < dpw; ++i) {
+            *t++ = RADIX_CHARS[x & mask];
+            x >>= shift;
+        }
+    } else {
+        uint8_t base = rp->base;
+        for (size_t i = 0; i < dpw; ++i) {
+            *t++ = RADIX_CHARS[x % base];
+            x /= base;
+        }
+    }
+    return t;
+}
+
+// Steals (takes move references to):
+//   * 'a'.
+//
+// Writes the base-'rp->base' digits of integer 'a' to 'p', left-padded with zeros to 'npad' digits,
+// by splitting off a word's worth of digits per pass. If 'npad' is zero, writes no leading zeros
+// (so nothing at all if 'a' is zero). Returns the new end of the output.
+static char *write_digits_basecase(RadixPowers *rp, Number *a, size_t npad, char *p)
+{
+    size_t nwa = a->nwords;
+    deci_UWORD *wa     = uu_xmemdup(a->words, nwa * sizeof(deci_UWORD));
+    deci_UWORD *wa_end = deci_normalize(wa, wa + nwa);
+    value_unref((Value) a);
+
+    char *tmp = uu_xmalloc(2 * nwa + 1, rp->dpw);
+    char *t = tmp;
+    while (wa_end != wa) {
+        deci_UWORD chunk = deci_divmod_uword(wa, wa_end, rp->wpow);
+        wa_end = deci_normalize(wa, wa_end);
+        t = emit_chunk_reversed(rp, chunk, t);
+    }
+    while (t != tmp && t[-1] == '0')
+        --t;
+
+    for (size_t i = t - tmp; i < npad; ++i)
+        *p++ = '0';
+    while (t != tmp)
+        *p++ = *--t;
+
+    free(tmp);
+    free(wa);
+    return p;
+}
+
+// Same as 'write_digits_basecase()', but subquadratic: 'a' is split into a quotient and a
+// remainder by a cached power of the base with roughly a quarter to a half of its words.
+static char *write_digits(RadixPowers *rp, Number *a, size_t npad, char *p)
+{
+    size_t nwa = a->nwords;
+    if (nwa <= TOSTRING_BASECASE_NWORDS)
+        return write_digits_basecase(rp, a, npad, p);
+
+    size_t k = 0;
+    while (radix_powers_get(rp, k)->nwords * 4 <= nwa)
+        ++k;
+    Number *pw = radix_powers_get(rp, k);
+    size_t nlo = rp->dpw << k;
+
+    value_ref((Value) a);
+    value_ref((Value) pw);
+    Number *q = number_idiv(a, pw);
+
+    value_ref((Value) q);
+    value_ref((Value) pw);
+    Number *r = number_sub(a, number_mul(q, pw));
+
+    p = write_digits(rp, q, npad ? npad - nlo : 0, p);
+    return write_digits(rp, r, nlo, p);
+}
+
 size_t number_tostring_base(Number *a, uint8_t base, size_t nfrac, char *r)
 {
-    static const char *CHARS = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    size_t nwa = a->nwords;
+    size_t sa = a->scale;
 
-    deci_UWORD *wx = uu_xmemdup(a->words, a->nwords * sizeof(deci_UWORD));
-    deci_UWORD *wx_int = wx + a->scale;
-    deci_UWORD *wx_end = wx + a->nwords;
+    RadixPowers rp = radix_powers_new(base);
 
     // Points to the *next* char to be written to the result buffer.
     char *p = r;
 
+    if (a->sign)
+        *p++ = '-';
+
     // Write the digits of the integer part.
-    while (wx_end != wx_int) {
-        deci_UWORD digit = deci_divmod_uword(wx_int, wx_end, base);
-        *p++ = CHARS[digit];
-        wx_end = deci_normalize(wx_int, wx_end);
-    }
+    Number *ipart = allocate(/*sign=*/0, /*nwords=*/nwa - sa, /*scale=*/0);
+    deci_memcpy(/*dst=*/ipart->words, /*src=*/a->words + sa, /*n=*/nwa - sa);
 
-    if (p == r) {
+    char *int_begin = p;
+    p = write_digits(&rp, ipart, /*npad=*/0, p);
+    if (p == int_begin) {
         // No digits in the integer part.
         *p++ = '0';
     }
 
-    if (a->sign)
-        *p++ = '-';
-
-    span_reverse(r, p);
-
     *p++ = '.';
 
-    // Write the digits of the fractional part.
-    for (size_t i = 0; i < nfrac; ++i) {
-        deci_UWORD digit = deci_mul_uword(wx, wx_int, base);
-        *p++ = CHARS[digit];
+    // Write the digits of the fractional part: these are the digits of
+    // 'floor(frac(a) * base ** nfrac)', padded to 'nfrac'.
+    if (nfrac) {
+        Number *fpart = allocate(/*sign=*/0, /*nwords=*/sa, /*scale=*/sa);
+        deci_memcpy(/*dst=*/fpart->words, /*src=*/a->words, /*n=*/sa);
+
+        Number *mul = number_pow_zu(number_new_from_zu(base), nfrac);
+        fpart = number_trunc(number_mul(fpart, mul));
+        p = write_digits(&rp, fpart, /*npad=*/nfrac, p);
     }
 
+    radix_powers_destroy(&rp);
+
     // Remove *trailing* zeros (in the fractional part).
     // We have already produced at least a '.', so it's safe to dereference 'p[-1]'.
     while (p[-1] == '0')
@@ -510,8 +896,6 @@ size_t number_tostring_base(Number *a, uint8_t base, size_t nfrac, char *r)
     if (p[-1] == '.')
         --p;
 
-    free(wx);
-
     return finalize_tostring(r, p);
 }
 
@@ -641,11 +1025,39 @@ static Number *mkuniq_extend(Number *a, size_t new_nwords)
     return r;
 }
 
+// Steals (takes move references to):
+//   * 'a';
+//   * 'b'.
+static Number *small_add_or_sub(Number *a, Number *b, bool add)
+{
+    deci_UWORD x = number_small_word(a);
+    deci_UWORD y = number_small_word(b);
+    char sign = a->sign;
+
+    if (a->sign ^ b->sign ^ add) {
+        // 'x + y' may overflow 'deci_UWORD' if 'DECI_BASE' is close to its maximum value.
+        deci_DOUBLE_UWORD sum = ((deci_DOUBLE_UWORD) x) + y;
+        if (UU_UNLIKELY(sum >= DECI_BASE))
+            return NULL;
+        return small_result(a, b, sign, sum);
+    }
+
+    if (x >= y)
+        return small_result(a, b, sign, x - y);
+    return small_result(a, b, sign ^ 1, y - x);
+}
+
 // Steals (takes move references to):
 //   * 'a';
 //   * 'b'.
 static Number *do_add_or_sub(Number *a, Number *b, bool add)
 {
+    if (number_is_small(a) && number_is_small(b)) {
+        Number *r = small_add_or_sub(a, b, add);
+        if (UU_LIKELY(r != NULL))
+            return r;
+    }
+
     size_t nwa = a->nwords;
     size_t nwb = b->nwords;
     bool negate_result = false;
@@ -685,14 +1097,14 @@ static Number *do_add_or_sub(Number *a, Number *b, bool add)
     deci_UWORD *wb_end = wb + nwb;
 
     if (a->sign ^ b->sign ^ add) {
-        if (deci_add(
+        if (fancy_add(
                 wa + sa - sb,   wa_end,
                 wb,             wb_end))
         {
             a = unsafe_push_word(a, 1);
         }
     } else {
-        if (deci_sub_raw(
+        if (fancy_sub_raw(
                 wa + sa - sb,   wa_end,
                 wb,             wb_end))
         {
@@ -747,6 +1159,12 @@ Number *number_abs_add_uword(Number *a, deci_UWORD b)
 
 Number *number_mul(Number *a, Number *b)
 {
+    if (number_is_small(a) && number_is_small(b)) {
+        deci_DOUBLE_UWORD prod = ((deci_DOUBLE_UWORD) number_small_word(a)) * number_small_word(b);
+        if (prod < DECI_BASE)
+            return small_result(a, b, a->sign ^ b->sign, prod);
+    }
+
     size_t nwa = a->nwords;
     size_t nwb = b->nwords;
 
@@ -754,7 +1172,10 @@ Number *number_mul(Number *a, Number *b)
     size_t sr = a->scale + b->scale;
 
     Number *r = allocate(/*sign=*/a->sign ^ b->sign, /*nwords=*/nwr, /*scale=*/sr);
-    fancy_mul(a->words, nwa, b->words, nwb, r->words);
+    if (a == b)
+        fancy_sqr(a->words, nwa, r->words);
+    else
+        fancy_mul(a->words, nwa, b->words, nwb, r->words);
 
     r = unsafe_normalize_full(r);
 
@@ -779,6 +1200,138 @@ Number *number_mul_uword(Number *a, deci_UWORD b)
     return a;
 }
 
+// 'log2(DECI_BASE)', that is, 'DECI_BASE_LOG log2(10)'.
+static const double LOG2_BASE = DECI_BASE_LOG * 3.321928094887362;
+
+// Approximate 'log2(v)' for 'v >= 1'.
+static double approx_log2_double(double v)
+{
+    double r = 0;
+    for (; v >= 2; v /= 2)
+        r += 1;
+    double bit = 1;
+    for (int i = 0; i < 40; ++i) {
+        bit /= 2;
+        v *= v;
+        if (v >= 2) {
+            v /= 2;
+            r += bit;
+        }
+    }
+    return r;
+}
+
+// Saturating conversion of a non-negative 'x'.
+static size_t zu_from_double(double x)
+{
+    return x < (double) (SIZE_MAX / 2) ? (size_t) x : SIZE_MAX / 2;
+}
+
+// Window width for sliding-window exponentiation with an 'nbits'-bit exponent.
+static inline unsigned pow_window_width(unsigned nbits)
+{
+    static const unsigned THRESHOLDS[] = {24, 80, 240, 672};
+    unsigned w = 1;
+    while (w <= sizeof(THRESHOLDS) / sizeof(THRESHOLDS[0]) && nbits > THRESHOLDS[w - 1])
+        ++w;
+    return w;
+}
+
+// Size, in words, that is enough for 'wr' in 'pow_words()'. The powers of 'wm' it computes have at
+// most 'e log_BASE(wm) + 1' words, and each product is written one word longer than that; the last
+// word covers the rounding of the logarithm.
+static size_t pow_nwords_bound(deci_UWORD *wm, size_t nwm, size_t e)
+{
+    double nwords_m = (double) (nwm - 1) + approx_log2_double(wm[nwm - 1] + 1.0) / LOG2_BASE;
+    return uu_add_zu_or_saturate(zu_from_double(nwords_m * (double) e), 4);
+}
+
+// Raises the 'nwm'-word non-zero integer 'wm' to the power of 'e' ('e >= 1') with sliding-window
+// exponentiation. The result is written into 'wr', of 'nwr' words, which must be at least
+// 'pow_nwords_bound(wm, nwm, e)'; returns its normalized size.
+//
+// The intermediate values ping-pong between 'wr' and a single buffer of the same size. The odd
+// powers of 'wm' for the window table are computed once and kept in one allocation.
+static size_t pow_words(deci_UWORD *wm, size_t nwm, size_t e, deci_UWORD *wr, size_t nwr)
+{
+    unsigned nbits = CHAR_BIT * sizeof(unsigned long long) - __builtin_clzll(e);
+    // With a single-word base, a multiplication is linear, and the plain binary method is best.
+    unsigned w = nwm == 1 ? 1 : pow_window_width(nbits);
+    size_t ntab = ((size_t) 1) << (w - 1);
+
+    // 'tab + off[i]' holds 'wm^(2*i+1)' of 'ntw[i]' words.
+    size_t *off = uu_xmalloc(2 * ntab, sizeof(size_t));
+    size_t *ntw = off + ntab;
+    size_t tab_size = 0;
+    for (size_t i = 0; i < ntab; ++i) {
+        off[i] = tab_size;
+        tab_size = uu_add_zu_or_saturate(tab_size, uu_mul_zu_or_saturate(2 * i + 1, nwm));
+    }
+    // The square of 'wm', if needed, lives past the table.
+    size_t nsq = uu_mul_zu_or_saturate(2, nwm);
+    deci_UWORD *tab = uu_xmalloc(
+        uu_add_zu_or_saturate(tab_size, ntab > 1 ? nsq : 0),
+        sizeof(deci_UWORD));
+
+    deci_memcpy(tab, wm, nwm);
+    ntw[0] = nwm;
+    if (ntab > 1) {
+        deci_UWORD *sq = tab + tab_size;
+        fancy_sqr(wm, nwm, sq);
+        nsq = deci_normalize_n(sq, nsq);
+        for (size_t i = 1; i < ntab; ++i) {
+            deci_UWORD *prev = tab + off[i - 1];
+            fancy_mul(prev, ntw[i - 1], sq, nsq, tab + off[i]);
+            ntw[i] = deci_normalize_n(tab + off[i], ntw[i - 1] + nsq);
+        }
+    }
+
+    deci_UWORD *cur = wr;
+    deci_UWORD *other = uu_xmalloc(nwr, sizeof(deci_UWORD));
+    size_t ncur = 0;
+
+    for (int i = nbits - 1; i >= 0;) {
+        if (!((e >> i) & 1)) {
+            fancy_sqr(cur, ncur, other);
+            SWAP(cur, other);
+            ncur = deci_normalize_n(cur, 2 * ncur);
+            --i;
+            continue;
+        }
+        // Take the longest window 'e[i ... j]' that fits and ends with a one bit.
+        int j = i - (int) w + 1;
+        if (j < 0)
+            j = 0;
+        while (!((e >> j) & 1))
+            ++j;
+        size_t v = (e >> j) & ((((size_t) 2) << (i - j)) - 1);
+        size_t t = v >> 1;
+
+        if (ncur) {
+            for (int k = i - j + 1; k; --k) {
+                fancy_sqr(cur, ncur, other);
+                SWAP(cur, other);
+                ncur = deci_normalize_n(cur, 2 * ncur);
+            }
+            fancy_mul(cur, ncur, tab + off[t], ntw[t], other);
+            SWAP(cur, other);
+            ncur = deci_normalize_n(cur, ncur + ntw[t]);
+        } else {
+            deci_memcpy(cur, tab + off[t], ntw[t]);
+            ncur = ntw[t];
+        }
+        i = j - 1;
+    }
+
+    if (cur != wr)
+        deci_memcpy(wr, cur, ncur);
+
+    free(other == wr ? cur : other);
+    free(tab);
+    free(off);
+    return ncur;
+}
+
 Number *number_pow_zu(Number *b, size_t e)
 {
     if (!e) {
@@ -786,30 +1339,51 @@ Number *number_pow_zu(Number *b, size_t e)
         return number_new_from_zu(1);
     }
 
-    size_t h = 1;
-    for (size_t tmp = e >> 1; tmp; tmp >>= 1)
-        h <<= 1;
-
-    b = mkuniq(b);
-    b = unsafe_normalize_full(b);
+    b = unsafe_normalize_full(mkuniq(b));
+    if (e == 1 || number_is_zero(b))
+        return b;
 
-    value_ref((Value) b);
-    Number *s = b;
+    // Write 'b' as 'm * 10^z / 10^(DECI_BASE_LOG * scale)', where 'm' is an integer not divisible
+    // by ten; then 'b^e' is 'm^e' with a decimal shift, and the shift is cheap.
+    size_t nwb = b->nwords;
+    deci_UWORD *wb = b->words;
+    size_t nzw = 0;
+    while (!wb[nzw])
+        ++nzw;
+    deci_UWORD f = 1;
+    unsigned nzd = 0;
+    while (wb[nzw] % (f * 10) == 0) {
+        f *= 10;
+        ++nzd;
+    }
 
-    while (h > 1) {
-        h >>= 1;
+    // 'pow_words()' does not work in place.
+    size_t nwm = nwb - nzw;
+    deci_UWORD *wm = uu_xmemdup(wb + nzw, nwm * sizeof(deci_UWORD));
+    if (f != 1)
+        (void) deci_divmod_uword(wm, wm + nwm, f);
+    nwm = deci_normalize_n(wm, nwm);
 
-        value_ref((Value) s);
-        s = number_mul(s, s);
+    size_t z_up = uu_mul_zu_or_saturate(uu_add_zu_or_saturate(nzw * DECI_BASE_LOG, nzd), e);
+    size_t z_down = uu_mul_zu_or_saturate(b->scale * DECI_BASE_LOG, e);
+    bool sign = b->sign && (e & 1);
+    value_unref((Value) b);
 
-        if (e & h) {
-            value_ref((Value) b);
-            s = number_mul(s, b);
-        }
+    Number *m;
+    if (nwm == 1 && wm[0] == 1) {
+        m = allocate(sign, /*nwords=*/1, /*scale=*/0);
+        m->words[0] = 1;
+    } else {
+        m = allocate(sign, /*nwords=*/pow_nwords_bound(wm, nwm, e), /*scale=*/0);
+        m = unsafe_reallocate(m, pow_words(wm, nwm, e, m->words, m->nwords));
     }
+    free(wm);
 
-    value_unref((Value) b);
-    return s;
+    if (z_up > z_down)
+        return number_scale_up(m, z_up - z_down);
+    if (z_down > z_up)
+        return number_scale_down(m, z_down - z_up);
+    return m;
 }
 
 bool number_abs_eq_uword(Number *a, deci_UWORD w)
@@ -854,25 +1428,191 @@ Number *number_pow(Number *b, Number *e)
     return number_pow_zu(b, x);
 }
 
+// Division by a single word with a precomputed reciprocal (Moller and Granlund, "Improved division
+// by invariant integers"). The dividend is formed in base 'DECI_BASE', but the reciprocal trick
+// works on the binary representation of each two-word step, '(r * DECI_BASE + u) / d' with
+// 'r < d'.
+
+enum { WORD_BITS = CHAR_BIT * sizeof(deci_UWORD) };
+
+typedef struct {
+    deci_UWORD d;
+    // 'd' shifted left so that its top bit is set, and the shift.
+    deci_UWORD dn;
+    int shift;
+    // 'floor((2^(2*WORD_BITS) - 1) / dn) - 2^WORD_BITS'.
+    deci_UWORD v;
+} WordDivisor;
+
+// Returns the precomputed divisor for 'd' ('d != 0'). The last one is cached, as the same small
+// divisor tends to be used many times in a row.
+static const WordDivisor *word_divisor(deci_UWORD d)
+{
+    static WordDivisor cache = {.d = 0};
+    if (cache.d != d) {
+        int shift = 0;
+        while (!((d << shift) >> (WORD_BITS - 1)))
+            ++shift;
+        deci_UWORD dn = d << shift;
+        deci_DOUBLE_UWORD num = (((deci_DOUBLE_UWORD) (deci_UWORD) ~dn) << WORD_BITS) |
+                                (deci_UWORD) ~(deci_UWORD) 0;
+        cache = (WordDivisor) {
+            .d = d,
+            .dn = dn,
+            .shift = shift,
+            .v = num / dn,
+        };
+    }
+    return &cache;
+}
+
+// Sets '*q = (*r * DECI_BASE + u) / wd->d', '*r = (*r * DECI_BASE + u) % wd->d'; '*r < wd->d'.
+static inline void word_divisor_step(
+        const WordDivisor *wd,
+        deci_UWORD *r, deci_UWORD u,
+        deci_UWORD *q)
+{
+    deci_DOUBLE_UWORD n = (((deci_DOUBLE_UWORD) *r) * DECI_BASE + u) << wd->shift;
+    deci_UWORD nh = n >> WORD_BITS;
+    deci_UWORD nl = n;
+
+    deci_DOUBLE_UWORD qq = ((deci_DOUBLE_UWORD) wd->v) * nh + n;
+    deci_UWORD qh = (qq >> WORD_BITS) + 1;
+    deci_UWORD ql = qq;
+    deci_UWORD rr = nl - qh * wd->dn;
+    if (rr > ql) {
+        --qh;
+        rr += wd->dn;
+    }
+    if (UU_UNLIKELY(rr >= wd->dn)) {
+        ++qh;
+        rr -= wd->dn;
+    }
+    *q = qh;
+    *r = rr >> wd->shift;
+}
+
+// Divides the integer formed by 'src[0 ... nsrc - 1]' followed by 'nzeros' zero words by 'wd->d',
+// writing the 'nsrc + nzeros'-word quotient into 'dst'; returns the remainder. 'dst' may be
+// 'src - nzeros'.
+static deci_UWORD word_divisor_divmod(
+        const WordDivisor *wd,
+        deci_UWORD *src, size_t nsrc,
+        deci_UWORD *dst, size_t nzeros)
+{
+    deci_UWORD r = 0;
+    for (size_t i = nsrc; i;) {
+        --i;
+        word_divisor_step(wd, &r, src[i], &dst[nzeros + i]);
+    }
+    for (size_t i = nzeros; i;) {
+        --i;
+        word_divisor_step(wd, &r, 0, &dst[i]);
+    }
+    return r;
+}
+
+// Returns the divisor's single word, or 0 if the integer part of 'b' is longer than that.
+static inline deci_UWORD int_part_single_word(Number *b)
+{
+    return b->nwords - b->scale == 1 ? b->words[b->scale] : 0;
+}
+
 // Steals (takes move references to):
 //   * 'a'.
-static Number *div_prepare(Number *a, size_t mul_base_pow, size_t min_scale)
+//
+// Returns 'a' with exactly 'sr + mul_base_pow' fractional words (truncating or extending with
+// zeros), but with the scale set to 'sr'.
+static Number *div_prepare(Number *a, size_t mul_base_pow, size_t sr)
 {
     size_t sa = a->scale;
-    size_t sr = min_scale > sa ? min_scale : sa;
-    a = mkuniq_scale_up(a, uu_add_zu_or_saturate(sr, mul_base_pow));
+    size_t s = uu_add_zu_or_saturate(sr, mul_base_pow);
+    a = sa > s ? mkuniq_scale_down(a, s) : mkuniq_scale_up(a, s);
     a->scale = sr;
     return a;
 }
 
+// Divides 'wa' by 'wb' when the divisor is much longer than the quotient, 'nq = nwa - nwb + 1':
+// the quotient is first estimated from the top 'nq + 2' words of the divisor (rounded up) and the
+// corresponding words of the dividend, which gives at most a couple units less than the exact
+// one, and then corrected with the full remainder. Writes the quotient into 'wa' and returns its
+// size.
+static size_t div_truncated(deci_UWORD *wa, size_t nwa, deci_UWORD *wb, size_t nwb, size_t nq)
+{
+    static deci_UWORD one = 1;
+
+    size_t t = nwb - nq - 2;
+    size_t nd = nwb - t;
+    size_t nat = nwa - t;
+
+    deci_UWORD *buf = uu_xmalloc(uu_add_zu_or_saturate(nd + 1 + nat, nwa + 1), sizeof(deci_UWORD));
+    deci_UWORD *d = buf;
+    deci_UWORD *at = d + nd + 1;
+    deci_UWORD *p = at + nat;
+
+    // 'q = floor(floor(a / B^t) / (floor(b / B^t) + 1))', which never exceeds 'floor(a / b)'.
+    deci_memcpy(d, wb + t, nd);
+    d[nd] = 0;
+    (void) deci_add(d, d + nd + 1, &one, &one + 1);
+    deci_memcpy(at, wa + t, nat);
+    size_t nqt = deci_normalize_n(at, fancy_div(at, nat, d, deci_normalize_n(d, nd + 1)));
+    deci_UWORD *q = at;
+
+    // 'a -= q * b'.
+    if (nqt) {
+        fancy_mul(q, nqt, wb, nwb, p);
+        size_t np = deci_normalize_n(p, nqt + nwb);
+        (void) deci_sub_raw(wa, wa + nwa, p, p + np);
+    }
+
+    // Correct 'q' while the remainder is at least 'b'.
+    deci_zero_out_n(q + nqt, nq - nqt);
+    while (!deci_sub_raw(wa, wa + nwa, wb, wb + nwb))
+        (void) deci_add(q, q + nq, &one, &one + 1);
+
+    deci_memcpy(wa, q, nq);
+    free(buf);
+    return nq;
+}
+
 Number *number_div(Number *a, Number *b, NumberTruncateParams ntp)
 {
-    a = div_prepare(a, /*mul_base_pow=*/b->scale, /*min_scale=*/ntp.scale);
+    // Only the digits of the quotient that are kept are computed: as 'floor(floor(x) / n)' is
+    // 'floor(x / n)' for any positive integer 'n', the words of 'a * B^(ntp.scale + sb)' below the
+    // point can be dropped in advance.
+    size_t sa = a->scale;
+    size_t sr = ntp.scale;
+    size_t s = uu_add_zu_or_saturate(sr, b->scale);
+
+    if (b->nwords == 1) {
+        // The words shifted in, if any, are divided without being stored.
+        size_t ndrop = sa > s ? sa - s : 0;
+        size_t nzeros = sa > s ? 0 : s - sa;
+        size_t nwa = a->nwords - ndrop;
+        size_t nwr = uu_add_zu_or_saturate(nwa, nzeros);
+
+        Number *r = allocate(/*sign=*/a->sign ^ b->sign, /*nwords=*/nwr, /*scale=*/sr);
+        (void) word_divisor_divmod(
+            word_divisor(b->words[0]),
+            a->words + a->nwords - nwa, nwa,
+            r->words, nzeros);
+
+        value_unref((Value) a);
+        value_unref((Value) b);
+        return unsafe_normalize_after_div(r, nwr, ntp);
+    }
+
+    a = div_prepare(a, /*mul_base_pow=*/b->scale, /*sr=*/sr);
     a->sign ^= b->sign;
 
-    size_t nwr = fancy_div(
-        /*wa=*/a->words, /*nwa=*/a->nwords,
-        /*wb=*/b->words, /*nwb=*/b->nwords);
+    // A fractional divisor may have leading zero words.
+    size_t nwa = deci_normalize_n(a->words, a->nwords);
+    size_t nwb = deci_normalize_n(b->words, b->nwords);
+    size_t nwr;
+    if (nwa >= nwb && 2 * (nwa - nwb + 3) <= nwb)
+        nwr = div_truncated(a->words, nwa, b->words, nwb, nwa - nwb + 1);
+    else
+        nwr = fancy_div(a->words, a->nwords, b->words, b->nwords);
 
     value_unref((Value) b);
     return unsafe_normalize_after_div(a, nwr, ntp);
@@ -880,6 +1620,21 @@ Number *number_div(Number *a, Number *b, NumberTruncateParams ntp)
 
 Number *number_imod(Number *a, Number *b)
 {
+    deci_UWORD d = int_part_single_word(b);
+    if (d) {
+        size_t sa = a->scale;
+        deci_UWORD *wa = a->words + sa;
+        size_t nwa = a->nwords - sa;
+        const WordDivisor *wd = word_divisor(d);
+        deci_UWORD r = 0;
+        for (size_t i = nwa; i;) {
+            --i;
+            deci_UWORD q;
+            word_divisor_step(wd, &r, wa[i], &q);
+        }
+        return small_result(a, b, a->sign, r);
+    }
+
     a = mkuniq_scale_down(a, 0);
 
     size_t nwr = fancy_mod(
@@ -892,6 +1647,25 @@ Number *number_imod(Number *a, Number *b)
 
 Number *number_idiv(Number *a, Number *b)
 {
+    deci_UWORD d = int_part_single_word(b);
+    if (d) {
+        char sign = a->sign ^ b->sign;
+        value_unref((Value) b);
+
+        size_t sa = a->scale;
+        size_t nwa = a->nwords - sa;
+        const WordDivisor *wd = word_divisor(d);
+        if (a->gc_hdr.nrefs == 1) {
+            (void) word_divisor_divmod(wd, a->words + sa, nwa, a->words + sa, 0);
+            a->sign = sign;
+            return unsafe_strip(a, deci_normalize_n(a->words + sa, nwa), 0);
+        }
+        Number *r = allocate(/*sign=*/sign, /*nwords=*/nwa, /*scale=*/0);
+        (void) word_divisor_divmod(wd, a->words + sa, nwa, r->words, 0);
+        value_unref((Value) a);
+        return unsafe_normalize_after_idiv(r, nwa);
+    }
+
     a = mkuniq_scale_down(a, 0);
 
     a->sign ^= b->sign;
@@ -904,35 +1678,3106 @@ Number *number_idiv(Number *a, Number *b)
     return unsafe_normalize_after_idiv(a, nwr);
 }
 
-Number *number_negate(Number *a)
-{
-    a = mkuniq(a);
-    a->sign ^= 1;
-    return a;
-}
+// Modular exponentiation with Barrett reduction (Handbook of Applied Cryptography, 14.42). With
+// 'n' the size of the modulus 'm' in words, 'mu = floor(DECI_BASE^(2n) / m)' is computed once;
+// then each 'x < m^2' is reduced with two multiplications instead of a division.
 
-Number *number_trunc(Number *a)
+typedef struct {
+    deci_UWORD *m;
+    size_t n;
+    deci_UWORD *mu;
+    size_t nmu;
+    // Scratch space: the product to reduce ('2n' words), 'q1 * mu' ('2n + 2' words), 'q3 * m'
+    // ('2n + 1' words), and the remainder ('n + 1' words).
+    deci_UWORD *t;
+    deci_UWORD *q;
+    deci_UWORD *p;
+    deci_UWORD *r;
+} Barrett;
+
+// 'wm' is the normalized 'n'-word modulus; it is borrowed for the lifetime of the context.
+static void barrett_init(Barrett *br, deci_UWORD *wm, size_t n)
 {
-    return mkuniq_scale_down(a, 0);
+    br->m = wm;
+    br->n = n;
+    br->mu = uu_xmalloc(uu_add_zu_or_saturate(uu_mul_zu_or_saturate(8, n), 6), sizeof(deci_UWORD));
+    br->t = br->mu + n + 2;
+    br->q = br->t + 2 * n;
+    br->p = br->q + 2 * n + 2;
+    br->r = br->p + 2 * n + 1;
+
+    deci_UWORD *x = br->q;
+    deci_zero_out_n(x, 2 * n);
+    x[2 * n] = 1;
+    size_t nx = fancy_div(x, 2 * n + 1, wm, n);
+    br->nmu = deci_normalize_n(x, nx);
+    deci_memcpy(br->mu, x, br->nmu);
 }
 
-Number *number_floor(Number *a)
+static void barrett_destroy(Barrett *br)
 {
-    if (a->sign && !number_is_fzero(a))
-        a = number_abs_add_uword(a, 1);
-    return mkuniq_scale_down(a, 0);
+    free(br->mu);
 }
 
-Number *number_ceil(Number *a)
+// Returns the sign of 'wa - wb', where 'wa' and 'wb' are both 'n' words long.
+static inline int words_compare(deci_UWORD *wa, deci_UWORD *wb, size_t n)
 {
-    if (!a->sign && !number_is_fzero(a))
-        a = number_abs_add_uword(a, 1);
-    return mkuniq_scale_down(a, 0);
+    for (size_t i = n; i;) {
+        --i;
+        if (wa[i] != wb[i])
+            return wa[i] < wb[i] ? -1 : 1;
+    }
+    return 0;
 }
 
-Number *number_round(Number *a)
+// 'out = x * y mod m', where 'x' and 'y' are 'n'-word residues; 'out' may be either of them.
+static void barrett_mulmod(Barrett *br, deci_UWORD *x, deci_UWORD *y, deci_UWORD *out)
 {
-    if (a->scale && a->words[a->scale - 1] >= DECI_BASE / 2)
+    size_t n = br->n;
+    size_t nx = deci_normalize_n(x, n);
+    size_t ny = x == y ? nx : deci_normalize_n(y, n);
+    if (!nx || !ny) {
+        deci_zero_out_n(out, n);
+        return;
+    }
+
+    deci_UWORD *t = br->t;
+    fancy_mul(x, nx, y, ny, t);
+    deci_zero_out_n(t + nx + ny, 2 * n - nx - ny);
+
+    // 'q1 = floor(t / DECI_BASE^(n-1))'; if it is zero, 't < m' already.
+    deci_UWORD *q1 = t + n - 1;
+    size_t nq1 = deci_normalize_n(q1, n + 1);
+    if (!nq1) {
+        deci_memcpy(out, t, n);
+        return;
+    }
+
+    // 'q3 = floor(q1 * mu / DECI_BASE^(n+1))'.
+    deci_UWORD *q = br->q;
+    size_t nq = nq1 + br->nmu;
+    fancy_mul(q1, nq1, br->mu, br->nmu, q);
+    size_t nq3 = nq > n + 1 ? deci_normalize_n(q + n + 1, nq - n - 1) : 0;
+
+    // 'r = (t - q3 * m) mod DECI_BASE^(n+1)', which is less than '3m'.
+    deci_UWORD *r = br->r;
+    deci_memcpy(r, t, n + 1);
+    if (nq3) {
+        deci_UWORD *p = br->p;
+        fancy_mul(q + n + 1, nq3, br->m, n, p);
+        (void) fancy_sub_raw(r, r + n + 1, p, p + n + 1);
+    }
+    while (r[n] || words_compare(r, br->m, n) >= 0)
+        (void) fancy_sub_raw(r, r + n + 1, br->m, br->m + n);
+
+    deci_memcpy(out, r, n);
+}
+
+// Converts the 'nwe'-word integer 'we' to binary, in 32-bit limbs, least significant first;
+// returns the limbs and stores the number of bits into '*nbits'. 'we' is destroyed.
+static uint32_t *words_to_binary(deci_UWORD *we, size_t nwe, size_t *nbits)
+{
+    // Each word holds less than 64 bits. A limb is split off in one division if a word can hold
+    // the divisor, and in two otherwise.
+    enum { CHUNK_BITS = sizeof(deci_UWORD) >= 8 ? 32 : 16 };
+    uint32_t *limbs = uu_xmalloc(uu_mul_zu_or_saturate(nwe, 2), sizeof(uint32_t));
+    size_t nlimbs = 0;
+    while ((nwe = deci_normalize_n(we, nwe))) {
+        uint32_t limb = 0;
+        for (unsigned k = 0; k < 32 && nwe; k += CHUNK_BITS) {
+            deci_UWORD chunk = deci_divmod_uword(we, we + nwe, ((deci_UWORD) 1) << CHUNK_BITS);
+            limb |= ((uint32_t) chunk) << k;
+            nwe = deci_normalize_n(we, nwe);
+        }
+        limbs[nlimbs++] = limb;
+    }
+
+    *nbits = 0;
+    if (nlimbs)
+        *nbits = 32 * (nlimbs - 1) + (32 - __builtin_clz(limbs[nlimbs - 1]));
+    return limbs;
+}
+
+static inline unsigned binary_bit(uint32_t *limbs, size_t i)
+{
+    return (limbs[i / 32] >> (i % 32)) & 1;
+}
+
+// 'out = b^e mod m' in the context 'br', where 'b' is an 'n'-word residue and 'e' is given in
+// binary as 'ebits' with 'nbits' bits ('nbits > 0'); 'out' may be 'b'.
+static void barrett_pow(Barrett *br, deci_UWORD *wb, uint32_t *ebits, size_t nbits, deci_UWORD *out)
+{
+    size_t n = br->n;
+
+    unsigned w = pow_window_width(nbits > UINT_MAX ? UINT_MAX : nbits);
+    size_t ntab = ((size_t) 1) << (w - 1);
+
+    // 'tab + i * n' holds 'b^(2*i+1) mod m'; the square of 'b' lives past the table.
+    deci_UWORD *tab = uu_xmalloc(
+        uu_mul_zu_or_saturate(ntab + 2, n),
+        sizeof(deci_UWORD));
+    deci_UWORD *sq = tab + ntab * n;
+    deci_UWORD *cur = sq + n;
+
+    deci_memcpy(tab, wb, n);
+    if (ntab > 1) {
+        barrett_mulmod(br, tab, tab, sq);
+        for (size_t i = 1; i < ntab; ++i)
+            barrett_mulmod(br, tab + (i - 1) * n, sq, tab + i * n);
+    }
+
+    bool started = false;
+    for (size_t i = nbits; i;) {
+        --i;
+        if (!binary_bit(ebits, i)) {
+            barrett_mulmod(br, cur, cur, cur);
+            continue;
+        }
+        // Take the longest window 'e[i ... j]' that fits and ends with a one bit.
+        size_t j = i + 1 >= w ? i + 1 - w : 0;
+        while (!binary_bit(ebits, j))
+            ++j;
+        size_t v = 0;
+        for (size_t k = i + 1; k > j;) {
+            --k;
+            v = (v << 1) | binary_bit(ebits, k);
+        }
+        deci_UWORD *entry = tab + (v >> 1) * n;
+
+        if (started) {
+            for (size_t k = i - j + 1; k; --k)
+                barrett_mulmod(br, cur, cur, cur);
+            barrett_mulmod(br, cur, entry, cur);
+        } else {
+            deci_memcpy(cur, entry, n);
+            started = true;
+        }
+        i = j;
+    }
+
+    deci_memcpy(out, cur, n);
+    free(tab);
+}
+
+// 'a mod m' in '[0, m)', for integers 'a' and 'm > 0'.
+//
+// Steals (takes move references to):
+//   * 'a'.
+//
+// Borrows (takes regular references to):
+//   * 'm'.
+static Number *int_mod(Number *a, Number *m)
+{
+    value_ref((Value) m);
+    a = number_imod(a, m);
+    if (a->sign && !number_is_zero(a)) {
+        value_ref((Value) m);
+        a = number_add(a, m);
+    }
+    return a;
+}
+
+Number *number_mod_pow(Number *b, Number *e, Number *m)
+{
+    b = int_mod(b, m);
+
+    size_t n = m->nwords - m->scale;
+    deci_UWORD *wm = m->words + m->scale;
+    size_t nwe = e->nwords - e->scale;
+
+    if (n == 1 && wm[0] == 1) {
+        value_unref((Value) b);
+        value_unref((Value) e);
+        value_unref((Value) m);
+        return number_new_from_zu(0);
+    }
+    if (!nwe || number_is_zero(b)) {
+        value_unref((Value) b);
+        value_unref((Value) m);
+        bool e_zero = !nwe;
+        value_unref((Value) e);
+        return number_new_from_zu(e_zero ? 1 : 0);
+    }
+
+    size_t nbits;
+    deci_UWORD *we = uu_xmemdup(e->words + e->scale, nwe * sizeof(deci_UWORD));
+    uint32_t *ebits = words_to_binary(we, nwe, &nbits);
+    free(we);
+    value_unref((Value) e);
+
+    Barrett br;
+    barrett_init(&br, wm, n);
+
+    Number *r = allocate(/*sign=*/0, /*nwords=*/n, /*scale=*/0);
+    size_t nwb = b->nwords - b->scale;
+    deci_memcpy(r->words, b->words + b->scale, nwb);
+    deci_zero_out_n(r->words + nwb, n - nwb);
+    value_unref((Value) b);
+
+    barrett_pow(&br, r->words, ebits, nbits, r->words);
+
+    free(ebits);
+    barrett_destroy(&br);
+    value_unref((Value) m);
+    return unsafe_normalize_after_idiv(r, n);
+}
+
+// Returns the integer 'x', which must be below 'DECI_BASE^2'.
+static Number *int_from_double_word(deci_DOUBLE_UWORD x)
+{
+    Number *r = allocate(/*sign=*/0, /*nwords=*/2, /*scale=*/0);
+    r->words[0] = x % DECI_BASE;
+    r->words[1] = x / DECI_BASE;
+    return unsafe_normalize_after_idiv(r, 2);
+}
+
+// Returns '|a|' with zero scale; 'a' must be an integer.
+//
+// Steals (takes move references to):
+//   * 'a'.
+static Number *int_abs(Number *a)
+{
+    if (!a->scale && !a->sign)
+        return a;
+    a = mkuniq_scale_down(a, 0);
+    a->sign = 0;
+    return a;
+}
+
+// Returns 'floor(|x| / DECI_BASE^p)' for an integer 'x' with zero scale.
+//
+// Borrows (takes regular references to):
+//   * 'x'.
+static Number *int_shift_down(Number *x, size_t p)
+{
+    size_t n = x->nwords > p ? x->nwords - p : 0;
+    Number *r = allocate(/*sign=*/0, /*nwords=*/n, /*scale=*/0);
+    deci_memcpy(r->words, x->words + p, n);
+    return r;
+}
+
+// Returns 'x * DECI_BASE^k' for a non-negative integer 'x' with zero scale.
+//
+// Steals (takes move references to):
+//   * 'x'.
+static Number *int_shift_up(Number *x, size_t k)
+{
+    if (number_is_zero(x))
+        return x;
+    Number *r = allocate(/*sign=*/0, /*nwords=*/x->nwords + k, /*scale=*/0);
+    deci_zero_out_n(r->words, k);
+    deci_memcpy(r->words + k, x->words, x->nwords);
+    value_unref((Value) x);
+    return r;
+}
+
+// Greatest common divisor.
+//
+// Below 'gcd_half' words, Lehmer's algorithm is used (Knuth, TAOCP vol. 2, 4.5.2, Algorithm L):
+// Euclid's algorithm runs on the two leading words of the operands for as long as the quotients it
+// finds are provably those of the full operands, and the single-word cofactors it accumulates are
+// then applied to the full operands in one pass. This replaces about 60 bits' worth of division
+// steps with two linear combinations.
+//
+// From 'gcd_half' words on, a half-gcd reduces the operands to about half their size first: the
+// cofactors that halve the top half of the operands are found recursively and applied to the full
+// operands with subquadratic multiplications, twice. The cofactors of truncated operands do not
+// always match those of the full ones; since any matrix of determinant +-1 preserves the gcd, the
+// result is only fixed up to stay non-negative and ordered, and a division step is taken whenever
+// such a round makes no progress.
+//
+// The operands are non-negative integers with zero scale, 'u >= v'. A 'GcdMatrix' tracks the
+// cofactors, '(u, v) = M * (a, b)' for the original operands 'a' and 'b'; both entries of a column
+// that is not needed are 'NULL', and not updated.
+
+typedef struct {
+    // Row-major.
+    Number *m[4];
+} GcdMatrix;
+
+// Largest magnitude of a cofactor found by 'lehmer_cofactors()'; see 'fancy_lincomb()'.
+#define LEHMER_COFACTOR_MAX ((((int64_t) 1) << (CHAR_BIT * sizeof(deci_UWORD) - 2)) - 1)
+
+// Signed integers that hold two words. Without 128-bit integers, libdeci uses 32-bit words.
+#ifdef __SIZEOF_INT128__
+typedef __int128 LehmerWide;
+#else
+typedef int64_t LehmerWide;
+#endif
+
+// 'mat = [[1, 0], [0, 1]]' if 'swap' is false, 'mat = [[0, 1], [1, 0]]' otherwise; only the columns
+// with 'track[j]' set are tracked.
+static void gcd_matrix_init(GcdMatrix *mat, const bool track[2], bool swap)
+{
+    for (int j = 0; j < 2; ++j) {
+        if (track[j]) {
+            mat->m[j] = number_new_from_zu(j == swap ? 1 : 0);
+            mat->m[2 + j] = number_new_from_zu(j == swap ? 0 : 1);
+        } else {
+            mat->m[j] = NULL;
+            mat->m[2 + j] = NULL;
+        }
+    }
+}
+
+static inline bool gcd_matrix_tracked(GcdMatrix *mat)
+{
+    return mat->m[0] || mat->m[1];
+}
+
+static void gcd_matrix_destroy(GcdMatrix *mat)
+{
+    for (int i = 0; i < 4; ++i)
+        if (mat->m[i])
+            value_unref((Value) mat->m[i]);
+}
+
+// Steals (takes move references to):
+//   * 'x'.
+static Number *mul_signed_word(Number *x, int64_t c)
+{
+    if (c >= 0)
+        return number_mul_uword(x, c);
+    x = number_mul_uword(x, -(deci_UWORD) c);
+    return number_is_zero(x) ? x : number_negate(x);
+}
+
+// Borrows (takes regular references to):
+//   * 'cx', 'x', 'cy', 'y'.
+static Number *dot2(Number *cx, Number *x, Number *cy, Number *y)
+{
+    value_ref((Value) cx);
+    value_ref((Value) x);
+    value_ref((Value) cy);
+    value_ref((Value) y);
+    return number_add(number_mul(cx, x), number_mul(cy, y));
+}
+
+// 'mat = [[c[0], c[1]], [c[2], c[3]]] * mat'.
+static void gcd_matrix_lmul_words(GcdMatrix *mat, const int64_t c[4])
+{
+    for (int j = 0; j < 2; ++j) {
+        Number *x = mat->m[j];
+        Number *y = mat->m[2 + j];
+        if (!x)
+            continue;
+        value_ref((Value) x);
+        value_ref((Value) y);
+        mat->m[j] = number_add(mul_signed_word(x, c[0]), mul_signed_word(y, c[1]));
+        mat->m[2 + j] = number_add(mul_signed_word(x, c[2]), mul_signed_word(y, c[3]));
+    }
+}
+
+// 'mat = [[0, 1], [1, -q]] * mat'.
+//
+// Borrows (takes regular references to):
+//   * 'q'.
+static void gcd_matrix_lmul_quotient(GcdMatrix *mat, Number *q)
+{
+    for (int j = 0; j < 2; ++j) {
+        Number *x = mat->m[j];
+        Number *y = mat->m[2 + j];
+        if (!x)
+            continue;
+        value_ref((Value) y);
+        value_ref((Value) q);
+        mat->m[j] = y;
+        mat->m[2 + j] = number_sub(x, number_mul(q, y));
+    }
+}
+
+// 'mat = sub * mat'.
+static void gcd_matrix_lmul(GcdMatrix *mat, GcdMatrix *sub)
+{
+    for (int j = 0; j < 2; ++j) {
+        Number *x = mat->m[j];
+        Number *y = mat->m[2 + j];
+        if (!x)
+            continue;
+        mat->m[j] = dot2(sub->m[0], x, sub->m[1], y);
+        mat->m[2 + j] = dot2(sub->m[2], x, sub->m[3], y);
+        value_unref((Value) x);
+        value_unref((Value) y);
+    }
+}
+
+// '(u, v) = (v, u mod v)'; 'v != 0'.
+static void gcd_divide(Number **pu, Number **pv, GcdMatrix *mat)
+{
+    Number *u = *pu;
+    Number *v = *pv;
+    if (gcd_matrix_tracked(mat)) {
+        value_ref((Value) u);
+        value_ref((Value) v);
+        Number *q = number_idiv(u, v);
+        gcd_matrix_lmul_quotient(mat, q);
+        value_unref((Value) q);
+    }
+    value_ref((Value) v);
+    *pu = v;
+    *pv = number_imod(u, v);
+}
+
+// Runs Euclid's algorithm on the two leading words of 'u' and 'v', 'u >= v > 0', and stores the
+// cofactors of the steps that are valid for the full operands into 'c'. Returns false if there are
+// none.
+static bool lehmer_cofactors(Number *u, Number *v, int64_t c[4])
+{
+    typedef LehmerWide Wide;
+
+    size_t n = u->nwords;
+    size_t nv = v->nwords;
+    Wide uh;
+    Wide vh;
+    if (n >= 2) {
+        uh = (Wide) u->words[n - 1] * DECI_BASE + u->words[n - 2];
+        vh = nv == n ? (Wide) v->words[n - 1] * DECI_BASE : 0;
+        vh += nv >= n - 1 ? v->words[n - 2] : 0;
+    } else {
+        uh = u->words[0];
+        vh = v->words[0];
+    }
+
+    // 'uh' and 'vh' are the operands divided by the same power of 'DECI_BASE', rounded down. While
+    // both '(uh + a) / (vh + c)' and '(uh + b) / (vh + d)' round to the same quotient, so does the
+    // ratio of the full operands transformed with '[[a, b], [c, d]]'.
+    Wide a = 1;
+    Wide b = 0;
+    Wide cc = 0;
+    Wide d = 1;
+    for (;;) {
+        if (vh + cc <= 0 || vh + d <= 0 || uh + a < 0 || uh + b < 0)
+            break;
+        Wide q = (uh + a) / (vh + cc);
+        if (q != (uh + b) / (vh + d) || q > LEHMER_COFACTOR_MAX)
+            break;
+        Wide next_c = a - q * cc;
+        Wide next_d = b - q * d;
+        if (next_c > LEHMER_COFACTOR_MAX || next_c < -LEHMER_COFACTOR_MAX ||
+            next_d > LEHMER_COFACTOR_MAX || next_d < -LEHMER_COFACTOR_MAX)
+        {
+            break;
+        }
+        a = cc;
+        b = d;
+        cc = next_c;
+        d = next_d;
+        Wide r = uh - q * vh;
+        uh = vh;
+        vh = r;
+    }
+    if (!b)
+        return false;
+    c[0] = a;
+    c[1] = b;
+    c[2] = cc;
+    c[3] = d;
+    return true;
+}
+
+// Writes 'x * u + y * v' into 'out', which has 'max(nu, nv) + 1' words; 'x' and 'y' have opposite
+// signs (or either is zero), and the result is non-negative.
+static void lincomb_signed(Number *u, int64_t x, Number *v, int64_t y, deci_UWORD *out)
+{
+    if (y > 0)
+        fancy_lincomb(v->words, v->nwords, y, u->words, u->nwords, -(deci_UWORD) x, out);
+    else
+        fancy_lincomb(u->words, u->nwords, x, v->words, v->nwords, -(deci_UWORD) y, out);
+}
+
+// '(u, v) = [[c[0], c[1]], [c[2], c[3]]] * (u, v)'.
+static void lehmer_apply(Number **pu, Number **pv, const int64_t c[4])
+{
+    Number *u = *pu;
+    Number *v = *pv;
+    size_t n = u->nwords + 1;
+
+    Number *new_u = allocate(/*sign=*/0, /*nwords=*/n, /*scale=*/0);
+    Number *new_v = allocate(/*sign=*/0, /*nwords=*/n, /*scale=*/0);
+    lincomb_signed(u, c[0], v, c[1], new_u->words);
+    lincomb_signed(u, c[2], v, c[3], new_v->words);
+
+    value_unref((Value) u);
+    value_unref((Value) v);
+    *pu = unsafe_normalize_after_idiv(new_u, n);
+    *pv = unsafe_normalize_after_idiv(new_v, n);
+}
+
+// Greatest common divisor of 'u' and 'v' with at most two words each.
+static Number *gcd_double_word(Number *u, Number *v)
+{
+    deci_DOUBLE_UWORD x = u->nwords == 2 ? (deci_DOUBLE_UWORD) u->words[1] * DECI_BASE : 0;
+    deci_DOUBLE_UWORD y = v->nwords == 2 ? (deci_DOUBLE_UWORD) v->words[1] * DECI_BASE : 0;
+    x += u->nwords ? u->words[0] : 0;
+    y += v->nwords ? v->words[0] : 0;
+    while (y) {
+        deci_DOUBLE_UWORD r = x % y;
+        x = y;
+        y = r;
+    }
+    value_unref((Value) u);
+    value_unref((Value) v);
+    return int_from_double_word(x);
+}
+
+// Takes one step of Lehmer's algorithm, or of Euclid's if there is no valid Lehmer step; 'v != 0'.
+static void gcd_lehmer_step(Number **pu, Number **pv, GcdMatrix *mat)
+{
+    int64_t c[4];
+    if (lehmer_cofactors(*pu, *pv, c)) {
+        lehmer_apply(pu, pv, c);
+        gcd_matrix_lmul_words(mat, c);
+    } else {
+        gcd_divide(pu, pv, mat);
+    }
+}
+
+// Runs Lehmer's algorithm until 'v' has at most 'nstop' words.
+static void gcd_lehmer(Number **pu, Number **pv, GcdMatrix *mat, size_t nstop)
+{
+    while ((*pv)->nwords > nstop) {
+        if (!nstop && (*pu)->nwords <= 2 && !gcd_matrix_tracked(mat)) {
+            *pu = gcd_double_word(*pu, *pv);
+            *pv = number_new_from_zu(0);
+            return;
+        }
+        gcd_lehmer_step(pu, pv, mat);
+    }
+}
+
+// '(u, v) = sub * (u, v)', then makes both non-negative and 'u >= v', adjusting the rows of 'sub'.
+static void gcd_matrix_apply(GcdMatrix *sub, Number **pu, Number **pv)
+{
+    Number *u = dot2(sub->m[0], *pu, sub->m[1], *pv);
+    Number *v = dot2(sub->m[2], *pu, sub->m[3], *pv);
+    value_unref((Value) *pu);
+    value_unref((Value) *pv);
+
+    for (int i = 0; i < 2; ++i) {
+        Number **px = i ? &v : &u;
+        if ((*px)->sign) {
+            *px = number_negate(*px);
+            sub->m[2 * i] = number_negate(sub->m[2 * i]);
+            sub->m[2 * i + 1] = number_negate(sub->m[2 * i + 1]);
+        }
+    }
+    if (number_compare(u, v) == COMPARE_LESS) {
+        SWAP(u, v);
+        SWAP(sub->m[0], sub->m[2]);
+        SWAP(sub->m[1], sub->m[3]);
+    }
+    *pu = u;
+    *pv = v;
+}
+
+// Below this many words, the top parts are not worth splitting off; the last few words are removed
+// with Lehmer steps on the full operands.
+enum { HGCD_MIN_SPLIT = 16 };
+
+// Reduces '(u, v)', where 'u' has 'n' words, until 'v' has at most 'n / 2 + 1' words.
+static void hgcd(Number **pu, Number **pv, GcdMatrix *mat)
+{
+    size_t n = (*pu)->nwords;
+    size_t s = n / 2 + 1;
+    if (n < fancy_get_cutoffs().gcd_half) {
+        gcd_lehmer(pu, pv, mat, s);
+        return;
+    }
+
+    static const bool TRACK_ALL[2] = {true, true};
+
+    while ((*pv)->nwords > s) {
+        size_t m = (*pu)->nwords;
+        size_t nv = (*pv)->nwords;
+
+        // Reducing the top 'k' words to about 'k / 2' words shortens the operands by 'k / 2'
+        // words; the first round takes the top half, the second one what is left to reach 's'.
+        size_t k = 2 * (m - s);
+        if (k > n - s)
+            k = n - s;
+        if (k < HGCD_MIN_SPLIT) {
+            gcd_lehmer(pu, pv, mat, s);
+            break;
+        }
+        size_t p = m - k;
+
+        Number *tu = int_shift_down(*pu, p);
+        Number *tv = int_shift_down(*pv, p);
+        GcdMatrix sub;
+        gcd_matrix_init(&sub, TRACK_ALL, /*swap=*/false);
+        hgcd(&tu, &tv, &sub);
+        value_unref((Value) tu);
+        value_unref((Value) tv);
+
+        gcd_matrix_apply(&sub, pu, pv);
+        gcd_matrix_lmul(mat, &sub);
+        gcd_matrix_destroy(&sub);
+
+        if ((*pu)->nwords + (*pv)->nwords >= m + nv && (*pv)->nwords)
+            gcd_lehmer_step(pu, pv, mat);
+    }
+}
+
+// Runs the gcd to completion: on return, 'u' is the gcd and 'v' is zero.
+static void gcd_run(Number **pu, Number **pv, GcdMatrix *mat)
+{
+    size_t nhalf = fancy_get_cutoffs().gcd_half;
+    while ((*pv)->nwords && (*pv)->nwords >= nhalf) {
+        hgcd(pu, pv, mat);
+        if ((*pv)->nwords)
+            gcd_divide(pu, pv, mat);
+    }
+    gcd_lehmer(pu, pv, mat, 0);
+}
+
+Number *number_gcd(Number *a, Number *b)
+{
+    if (number_is_small(a) && number_is_small(b)) {
+        deci_UWORD x = number_small_word(a);
+        deci_UWORD y = number_small_word(b);
+        value_unref((Value) a);
+        value_unref((Value) b);
+        while (y) {
+            deci_UWORD r = x % y;
+            x = y;
+            y = r;
+        }
+        return number_new_from_zu(x);
+    }
+
+    Number *u = int_abs(a);
+    Number *v = int_abs(b);
+    if (number_compare(u, v) == COMPARE_LESS)
+        SWAP(u, v);
+
+    static const bool TRACK_NONE[2] = {false, false};
+    GcdMatrix mat;
+    gcd_matrix_init(&mat, TRACK_NONE, /*swap=*/false);
+    gcd_run(&u, &v, &mat);
+
+    value_unref((Value) v);
+    return u;
+}
+
+Number *number_ext_gcd(Number *a, Number *b, Number **x, Number **y)
+{
+    bool neg_a = a->sign && !number_is_zero(a);
+    bool neg_b = b->sign && !number_is_zero(b);
+    a = int_abs(a);
+    b = int_abs(b);
+
+    value_ref((Value) a);
+    value_ref((Value) b);
+    Number *u = a;
+    Number *v = b;
+    bool swap = number_compare(u, v) == COMPARE_LESS;
+    if (swap)
+        SWAP(u, v);
+
+    // Only the cofactor of 'a' is tracked; that of 'b' follows from it.
+    static const bool TRACK_A[2] = {true, false};
+    GcdMatrix mat;
+    gcd_matrix_init(&mat, TRACK_A, swap);
+    gcd_run(&u, &v, &mat);
+    value_unref((Value) v);
+
+    Number *g = u;
+    Number *xa = mat.m[0];
+    value_unref((Value) mat.m[2]);
+
+    Number *yb;
+    if (number_is_zero(b)) {
+        value_unref((Value) xa);
+        xa = number_new_from_zu(number_is_zero(a) ? 0 : 1);
+        yb = number_new_from_zu(0);
+        value_unref((Value) a);
+        value_unref((Value) b);
+    } else {
+        // Make 'xa' the cofactor of the smallest magnitude, in '(-b / (2 * g), b / (2 * g)]',
+        // and 'yb = (g - a * xa) / b'.
+        value_ref((Value) b);
+        value_ref((Value) g);
+        Number *bg = number_idiv(b, g);
+        value_ref((Value) bg);
+        xa = number_imod(xa, bg);
+        if (xa->sign && !number_is_zero(xa)) {
+            value_ref((Value) bg);
+            xa = number_add(xa, bg);
+        }
+        value_ref((Value) xa);
+        Number *xa2 = number_mul_uword(xa, 2);
+        if (number_compare(xa2, bg) == COMPARE_GREATER) {
+            value_ref((Value) bg);
+            xa = number_sub(xa, bg);
+        }
+        value_unref((Value) xa2);
+        value_unref((Value) bg);
+
+        value_ref((Value) g);
+        value_ref((Value) xa);
+        yb = number_idiv(number_sub(g, number_mul(a, xa)), b);
+    }
+
+    if (neg_a && !number_is_zero(xa))
+        xa = number_negate(xa);
+    if (neg_b && !number_is_zero(yb))
+        yb = number_negate(yb);
+    *x = xa;
+    *y = yb;
+    return g;
+}
+
+Number *number_mod_inverse(Number *a, Number *m)
+{
+    m = int_abs(m);
+
+    // 'a = a mod m', in '[0, m)'.
+    value_ref((Value) m);
+    a = number_imod(a, m);
+    if (a->sign && !number_is_zero(a)) {
+        value_ref((Value) m);
+        a = number_add(a, m);
+    }
+    a = int_abs(a);
+
+    // '(u, v) = (m, a)'; only the cofactor of 'a' is needed.
+    static const bool TRACK_A[2] = {false, true};
+    value_ref((Value) m);
+    Number *u = m;
+    Number *v = a;
+    GcdMatrix mat;
+    gcd_matrix_init(&mat, TRACK_A, /*swap=*/false);
+    gcd_run(&u, &v, &mat);
+    value_unref((Value) v);
+    value_unref((Value) mat.m[3]);
+
+    Number *r = mat.m[1];
+    bool invertible = number_abs_eq_uword(u, 1);
+    value_unref((Value) u);
+    if (!invertible) {
+        value_unref((Value) r);
+        value_unref((Value) m);
+        return NULL;
+    }
+
+    value_ref((Value) m);
+    r = number_imod(r, m);
+    if (r->sign && !number_is_zero(r))
+        r = number_add(r, m);
+    else
+        value_unref((Value) m);
+    return r;
+}
+
+// Integer roots. 'floor(a^(1/n))' is found with Newton's iteration
+//
+//     x' = floor(((n - 1) * x + floor(a / x^(n - 1))) / n),
+//
+// which, started above the root, decreases monotonically to it. The start is the root of the top
+// half of 'a', found recursively and scaled back up, so that each level only needs a step or two:
+// the precision doubles per step, and the recursion bottoms out in a seed computed in floating
+// point from the top two words.
+
+// Approximate 'log2(a)' for a positive integer 'a' with zero scale.
+static double approx_log2(Number *a)
+{
+    size_t m = a->nwords;
+    double v = a->words[m - 1];
+    size_t j = m - 1;
+    if (m > 1) {
+        v = v * DECI_BASE + a->words[m - 2];
+        --j;
+    }
+    return approx_log2_double(v) + j * LOG2_BASE;
+}
+
+// Approximate '2^x' for '0 <= x < 128'.
+static double approx_exp2(double x)
+{
+    double r = 1;
+    for (; x >= 1; x -= 1)
+        r *= 2;
+    // 'e^(x * ln 2)' with '0 <= x * ln 2 < 0.7'.
+    double y = x * 0.6931471805599453;
+    double s = 1;
+    double t = 1;
+    for (int i = 1; i < 24; ++i) {
+        t *= y / i;
+        s += t;
+    }
+    return r * s;
+}
+
+// An upper bound of 'floor(a^(1/n))' for 'a' with at most '2 * n' words, so that the root is below
+// 'DECI_BASE^2'.
+static Number *root_seed(Number *a, size_t n)
+{
+    double est = approx_exp2(approx_log2(a) / n) * (1 + 1e-9) + 2;
+    const double BASE_SQ = (double) DECI_BASE * DECI_BASE;
+    deci_DOUBLE_UWORD x;
+    if (est >= BASE_SQ)
+        x = (deci_DOUBLE_UWORD) DECI_BASE * DECI_BASE - 1;
+    else
+        x = est;
+    return int_from_double_word(x);
+}
+
+// Runs Newton's iteration for 'floor(a^(1/n))' from 'x', which must not be below it.
+//
+// Steals (takes move references to):
+//   * 'x'.
+//
+// Borrows (takes regular references to):
+//   * 'a'.
+static Number *root_newton(Number *a, size_t n, Number *x)
+{
+    value_ref((Value) x);
+    Number *p = number_pow_zu(x, n - 1);
+    for (;;) {
+        value_ref((Value) a);
+        Number *q = number_idiv(a, p);
+        Number *y = number_add(number_mul(x, number_new_from_zu(n - 1)), q);
+        y = number_idiv(y, number_new_from_zu(n));
+
+        // 'y' is never below the root, so 'y^n <= a' means it is the root.
+        value_ref((Value) y);
+        p = number_pow_zu(y, n - 1);
+        value_ref((Value) p);
+        value_ref((Value) y);
+        Number *t = number_mul(p, y);
+        bool done = number_compare(t, a) != COMPARE_GREATER;
+        value_unref((Value) t);
+        if (done) {
+            value_unref((Value) p);
+            return y;
+        }
+        x = y;
+    }
+}
+
+// 'floor(a^(1/n))' for a positive integer 'a' with zero scale.
+//
+// Borrows (takes regular references to):
+//   * 'a'.
+static Number *iroot_rec(Number *a, size_t n)
+{
+    size_t k = (a->nwords - 1) / (2 * n);
+    Number *x;
+    if (!k) {
+        x = root_seed(a, n);
+    } else {
+        // With 'r' the root of 'floor(a / DECI_BASE^(n * k))', the root of 'a' is below
+        // '(r + 1) * DECI_BASE^k'.
+        Number *top = int_shift_down(a, n * k);
+        Number *r = iroot_rec(top, n);
+        value_unref((Value) top);
+        x = int_shift_up(number_abs_add_uword(r, 1), k);
+    }
+    return root_newton(a, n, x);
+}
+
+Number *number_iroot(Number *a, size_t n)
+{
+    char sign = a->sign;
+    a = int_abs(a);
+    if (n == 1 || number_is_zero(a) || number_abs_eq_uword(a, 1)) {
+        a->sign = sign;
+        return a;
+    }
+
+    Number *r;
+    if (approx_log2(a) < n - 1.0) {
+        // 'a < 2^n'.
+        r = number_new_from_zu(1);
+    } else {
+        r = iroot_rec(a, n);
+    }
+    value_unref((Value) a);
+    if (sign)
+        r = number_negate(r);
+    return r;
+}
+
+Number *number_root(Number *a, size_t n, NumberTruncateParams ntp)
+{
+    size_t prec = ntp_to_prec(ntp);
+    a = number_trunc(number_scale_up(a, uu_mul_zu_or_saturate(prec, n)));
+    return number_scale_down(number_iroot(a, n), prec);
+}
+
+// Primality testing. Candidates are first trial-divided by the primes below 'PRIME_TRIAL_LIMIT',
+// a group at a time: the primes are packed into products below 'DECI_BASE', so that each group
+// costs a single pass of word remainders. A candidate of one word that survives is then decided
+// exactly by Miller-Rabin with a fixed set of bases; a larger one gets a round with base 2 and
+// 'nrounds' rounds with pseudo-random bases, all sharing one Barrett context.
+
+enum {
+    // Bound of the table of small primes.
+    SMALL_PRIME_LIMIT = 1 << 16,
+    // Bound of the primes tried before a primality test.
+    PRIME_TRIAL_LIMIT = 1 << 10,
+};
+
+typedef struct {
+    deci_UWORD prod;
+    // Range of the primes in 'small_primes.p'.
+    uint16_t begin;
+    uint16_t end;
+} SmallPrimeGroup;
+
+static struct {
+    // There are 6542 primes below '2^16'.
+    uint16_t p[SMALL_PRIME_LIMIT / 8];
+    size_t np;
+    SmallPrimeGroup groups[SMALL_PRIME_LIMIT / 8];
+    size_t ngroups;
+} small_primes;
+
+static void small_primes_init(void)
+{
+    if (small_primes.np)
+        return;
+
+    bool *composite = uu_xcalloc(SMALL_PRIME_LIMIT, sizeof(bool));
+    for (size_t i = 2; i < SMALL_PRIME_LIMIT; ++i) {
+        if (composite[i])
+            continue;
+        small_primes.p[small_primes.np++] = i;
+        for (size_t j = i * i; j < SMALL_PRIME_LIMIT; j += i)
+            composite[j] = true;
+    }
+    free(composite);
+
+    SmallPrimeGroup g = {.prod = 1, .begin = 0};
+    for (size_t i = 0; i < small_primes.np; ++i) {
+        deci_UWORD p = small_primes.p[i];
+        if (g.prod > (DECI_BASE - 1) / p) {
+            g.end = i;
+            small_primes.groups[small_primes.ngroups++] = g;
+            g = (SmallPrimeGroup) {.prod = 1, .begin = i};
+        }
+        g.prod *= p;
+    }
+    g.end = small_primes.np;
+    small_primes.groups[small_primes.ngroups++] = g;
+}
+
+// Returns the remainder of the 'n'-word integer 'w' modulo 'd'.
+static deci_UWORD words_mod_word(deci_UWORD *w, size_t n, deci_UWORD d)
+{
+    const WordDivisor *wd = word_divisor(d);
+    deci_UWORD r = 0;
+    for (size_t k = n; k;) {
+        --k;
+        deci_UWORD q;
+        word_divisor_step(wd, &r, w[k], &q);
+    }
+    return r;
+}
+
+// Returns the smallest prime below 'limit' that divides the 'n'-word integer 'w', or zero if there
+// is none. A prime somewhat above 'limit' may be returned instead of zero.
+static deci_UWORD small_prime_factor(deci_UWORD *w, size_t n, deci_UWORD limit)
+{
+    small_primes_init();
+    for (size_t i = 0; i < small_primes.ngroups; ++i) {
+        const SmallPrimeGroup *g = &small_primes.groups[i];
+        if (small_primes.p[g->begin] >= limit)
+            break;
+        deci_UWORD r = words_mod_word(w, n, g->prod);
+        for (size_t j = g->begin; j < g->end; ++j)
+            if (r % small_primes.p[j] == 0)
+                return small_primes.p[j];
+    }
+    return 0;
+}
+
+static inline deci_UWORD word_mulmod(deci_UWORD a, deci_UWORD b, deci_UWORD m)
+{
+    return ((deci_DOUBLE_UWORD) a) * b % m;
+}
+
+// Whether the odd 'n > a' is a strong probable prime to base 'a'.
+static bool word_is_sprp(deci_UWORD n, deci_UWORD a)
+{
+    deci_UWORD d = n - 1;
+    int s = __builtin_ctzll(d);
+    d >>= s;
+
+    deci_UWORD x = 1;
+    for (deci_UWORD b = a; d; d >>= 1) {
+        if (d & 1)
+            x = word_mulmod(x, b, n);
+        b = word_mulmod(b, b, n);
+    }
+    if (x == 1 || x == n - 1)
+        return true;
+    for (int i = 1; i < s; ++i) {
+        x = word_mulmod(x, x, n);
+        if (x == n - 1)
+            return true;
+    }
+    return false;
+}
+
+// Decides whether 'n' is prime, for 'n' not divisible by any prime below 'PRIME_TRIAL_LIMIT'. The
+// bases are enough for all 'n < 3.18 * 10^23' (Sorenson and Webster, 2015).
+static bool word_is_prime(deci_UWORD n)
+{
+    if (n < PRIME_TRIAL_LIMIT * PRIME_TRIAL_LIMIT)
+        return n > 1;
+    static const deci_UWORD BASES[] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37};
+    for (size_t i = 0; i < sizeof(BASES) / sizeof(BASES[0]); ++i)
+        if (!word_is_sprp(n, BASES[i]))
+            return false;
+    return true;
+}
+
+typedef struct {
+    Barrett br;
+    // 'n - 1', and its odd part 'd' in binary, with 'n - 1 = d * 2^s'.
+    deci_UWORD *wm1;
+    uint32_t *dbits;
+    size_t nbits;
+    size_t s;
+    deci_UWORD *x;
+} MillerRabin;
+
+// 'wm' is the 'n'-word odd modulus, 'n > 1'; it is borrowed for the lifetime of the context.
+static void miller_rabin_init(MillerRabin *mr, deci_UWORD *wm, size_t n)
+{
+    barrett_init(&mr->br, wm, n);
+    mr->wm1 = uu_xmalloc(uu_mul_zu_or_saturate(3, n), sizeof(deci_UWORD));
+    mr->x = mr->wm1 + n;
+
+    deci_UWORD *t = mr->x + n;
+    deci_memcpy(mr->wm1, wm, n);
+    --mr->wm1[0];
+    deci_memcpy(t, mr->wm1, n);
+    size_t nbits;
+    uint32_t *bits = words_to_binary(t, n, &nbits);
+
+    size_t s = 0;
+    while (!binary_bit(bits, s))
+        ++s;
+    size_t nlimbs = (nbits - s + 31) / 32;
+    for (size_t i = 0; i < nlimbs; ++i) {
+        size_t k = s / 32 + i;
+        uint64_t v = bits[k];
+        if (k + 1 < (nbits + 31) / 32)
+            v |= ((uint64_t) bits[k + 1]) << 32;
+        bits[i] = v >> (s % 32);
+    }
+    mr->dbits = bits;
+    mr->nbits = nbits - s;
+    mr->s = s;
+}
+
+static void miller_rabin_destroy(MillerRabin *mr)
+{
+    free(mr->dbits);
+    free(mr->wm1);
+    barrett_destroy(&mr->br);
+}
+
+static inline bool words_is_one(deci_UWORD *w, size_t n)
+{
+    return w[0] == 1 && deci_normalize_n(w, n) == 1;
+}
+
+// Whether the modulus is a strong probable prime to base 'a', an 'n'-word residue in '[2, n - 2]'.
+static bool miller_rabin_round(MillerRabin *mr, deci_UWORD *wa)
+{
+    size_t n = mr->br.n;
+    deci_UWORD *x = mr->x;
+    barrett_pow(&mr->br, wa, mr->dbits, mr->nbits, x);
+    if (words_is_one(x, n) || words_compare(x, mr->wm1, n) == 0)
+        return true;
+    for (size_t i = 1; i < mr->s; ++i) {
+        barrett_mulmod(&mr->br, x, x, x);
+        if (words_compare(x, mr->wm1, n) == 0)
+            return true;
+        if (words_is_one(x, n))
+            return false;
+    }
+    return false;
+}
+
+// xorshift64*.
+static inline uint64_t prng_next(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+bool number_is_probable_prime(Number *a, size_t nrounds, uint64_t seed)
+{
+    if (a->sign)
+        return false;
+    deci_UWORD *w = a->words + a->scale;
+    size_t n = deci_normalize_n(w, a->nwords - a->scale);
+    if (!n)
+        return false;
+
+    deci_UWORD p = small_prime_factor(w, n, PRIME_TRIAL_LIMIT);
+    if (p)
+        return n == 1 && w[0] == p;
+    if (n == 1)
+        return word_is_prime(w[0]);
+
+    MillerRabin mr;
+    miller_rabin_init(&mr, w, n);
+
+    deci_UWORD *wa = uu_xmalloc(n, sizeof(deci_UWORD));
+    deci_zero_out_n(wa, n);
+    wa[0] = 2;
+    bool r = miller_rabin_round(&mr, wa);
+
+    uint64_t state = seed | 1;
+    for (size_t i = 0; r && i < nrounds; ++i) {
+        // A base below the modulus: the top word is below that of the modulus.
+        do {
+            for (size_t k = 0; k < n; ++k) {
+                uint64_t v;
+                do
+                    v = prng_next(&state);
+                while (v >= (UINT64_MAX / DECI_BASE) * DECI_BASE);
+                wa[k] = v % DECI_BASE;
+            }
+            wa[n - 1] %= w[n - 1];
+        } while ((wa[0] < 2 && deci_normalize_n(wa, n) <= 1) || words_compare(wa, mr.wm1, n) == 0);
+        r = miller_rabin_round(&mr, wa);
+    }
+
+    free(wa);
+    miller_rabin_destroy(&mr);
+    return r;
+}
+
+// Factorization. The primes below 'SMALL_PRIME_LIMIT' are divided out first, a group at a time as
+// in the primality test. Each composite cofactor left is then split until only primes remain.
+// Perfect powers are split by taking a root. Cofactors of one word go to Pollard's rho, with
+// Brent's cycle finding, in double-word arithmetic. Larger ones get a bounded run of the same rho
+// modulo the cofactor with Barrett reduction, and then Lenstra's elliptic curve method (ECM) with
+// growing bounds.
+
+typedef struct {
+    Number *p;
+    size_t mult;
+} FactorEntry;
+
+typedef struct {
+    FactorEntry *data;
+    size_t size;
+    size_t capacity;
+} FactorStack;
+
+static void factor_stack_push(FactorStack *s, Number *p, size_t mult)
+{
+    if (s->size == s->capacity)
+        s->data = uu_x2realloc(s->data, &s->capacity, sizeof(FactorEntry));
+    s->data[s->size++] = (FactorEntry) {.p = p, .mult = mult};
+}
+
+// Returns the integer formed by the 'n' words of 'w'.
+static Number *int_from_words(deci_UWORD *w, size_t n)
+{
+    Number *r = allocate(/*sign=*/0, /*nwords=*/n, /*scale=*/0);
+    deci_memcpy(r->words, w, n);
+    return unsafe_normalize_after_idiv(r, n);
+}
+
+// Writes the residue 'x' into the 'n' words of 'out'.
+//
+// Steals (takes move references to):
+//   * 'x'.
+static void int_to_words(Number *x, deci_UWORD *out, size_t n)
+{
+    deci_memcpy(out, x->words, x->nwords);
+    deci_zero_out_n(out + x->nwords, n - x->nwords);
+    value_unref((Value) x);
+}
+
+// Returns 'gcd(x, a)' if it is neither 1 nor 'a', or 'NULL'.
+//
+// Steals (takes move references to):
+//   * 'x'.
+//
+// Borrows (takes regular references to):
+//   * 'a'.
+static Number *nontrivial_gcd(Number *x, Number *a)
+{
+    value_ref((Value) a);
+    Number *g = number_gcd(x, a);
+    if (number_abs_eq_uword(g, 1) || number_compare(g, a) == COMPARE_EQ) {
+        value_unref((Value) g);
+        return NULL;
+    }
+    return g;
+}
+
+// 'out = x + y mod m' for 'n'-word residues; 'out' may be either of them.
+static void mod_add(deci_UWORD *x, deci_UWORD *y, deci_UWORD *out, deci_UWORD *m, size_t n)
+{
+    bool c = false;
+    for (size_t i = 0; i < n; ++i) {
+        deci_UWORD t = DECI_BASE - y[i];
+        deci_UWORD s = x[i] + c;
+        c = s >= t;
+        out[i] = c ? s - t : s + y[i];
+    }
+    if (c || words_compare(out, m, n) >= 0)
+        (void) fancy_sub_raw(out, out + n, m, m + n);
+}
+
+// 'out = x - y mod m' for 'n'-word residues; 'out' may be either of them.
+static void mod_sub(deci_UWORD *x, deci_UWORD *y, deci_UWORD *out, deci_UWORD *m, size_t n)
+{
+    bool b = false;
+    for (size_t i = 0; i < n; ++i) {
+        deci_UWORD t = y[i] + b;
+        b = x[i] < t;
+        out[i] = b ? x[i] + (DECI_BASE - t) : x[i] - t;
+    }
+    if (b)
+        (void) fancy_add(out, out + n, m, m + n);
+}
+
+static deci_UWORD word_gcd(deci_UWORD x, deci_UWORD y)
+{
+    while (y) {
+        deci_UWORD r = x % y;
+        x = y;
+        y = r;
+    }
+    return x;
+}
+
+// Returns a non-trivial factor of the odd composite 'n'.
+static deci_UWORD word_rho(deci_UWORD n)
+{
+    for (deci_UWORD c = 1;; ++c) {
+        deci_UWORD x = 2;
+        deci_UWORD y = 2;
+        deci_UWORD ys = 2;
+        deci_UWORD q = 1;
+        deci_UWORD g = 1;
+        for (size_t r = 1; g == 1; r *= 2) {
+            x = y;
+            for (size_t i = 0; i < r; ++i)
+                y = (word_mulmod(y, y, n) + c) % n;
+            for (size_t k = 0; k < r && g == 1; k += 128) {
+                ys = y;
+                for (size_t i = 0; i < 128 && i < r - k; ++i) {
+                    y = (word_mulmod(y, y, n) + c) % n;
+                    q = word_mulmod(q, x > y ? x - y : y - x, n);
+                }
+                g = word_gcd(q, n);
+            }
+        }
+        if (g == n) {
+            // The batch overshot: redo it one step at a time.
+            do {
+                ys = (word_mulmod(ys, ys, n) + c) % n;
+                g = word_gcd(x > ys ? x - ys : ys - x, n);
+            } while (g == 1);
+        }
+        if (g != n)
+            return g;
+    }
+}
+
+enum {
+    // Number of iterations of Pollard's rho on a multi-word cofactor before switching to ECM.
+    RHO_MAX_ITERS = 1 << 14,
+    // Number of steps between two 'gcd' computations in Pollard's rho.
+    RHO_BATCH = 128,
+};
+
+// Returns a non-trivial factor of the odd composite 'a' of at least two words, or 'NULL' if none is
+// found in 'RHO_MAX_ITERS' iterations.
+//
+// Borrows (takes regular references to):
+//   * 'a'.
+static Number *multiword_rho(Number *a)
+{
+    size_t n = a->nwords;
+    deci_UWORD *m = a->words;
+    Barrett br;
+    barrett_init(&br, m, n);
+
+    deci_UWORD *buf = uu_xmalloc(uu_mul_zu_or_saturate(6, n), sizeof(deci_UWORD));
+    deci_UWORD *x = buf;
+    deci_UWORD *y = x + n;
+    deci_UWORD *ys = y + n;
+    deci_UWORD *q = ys + n;
+    deci_UWORD *c = q + n;
+    deci_UWORD *t = c + n;
+    deci_zero_out_n(buf, 6 * n);
+    y[0] = 2;
+    q[0] = 1;
+    c[0] = 1;
+
+    Number *g = NULL;
+    size_t niters = 0;
+    for (size_t r = 1; !g && niters < RHO_MAX_ITERS; r *= 2) {
+        deci_memcpy(x, y, n);
+        for (size_t i = 0; i < r; ++i) {
+            barrett_mulmod(&br, y, y, y);
+            mod_add(y, c, y, m, n);
+        }
+        for (size_t k = 0; k < r && !g; k += RHO_BATCH) {
+            deci_memcpy(ys, y, n);
+            for (size_t i = 0; i < RHO_BATCH && i < r - k; ++i) {
+                barrett_mulmod(&br, y, y, y);
+                mod_add(y, c, y, m, n);
+                mod_sub(x, y, t, m, n);
+                barrett_mulmod(&br, q, t, q);
+            }
+            niters += RHO_BATCH;
+            if (deci_is_zero_n(q, n)) {
+                // The batch overshot: redo it one step at a time.
+                for (size_t i = 0; i < RHO_BATCH && !g; ++i) {
+                    barrett_mulmod(&br, ys, ys, ys);
+                    mod_add(ys, c, ys, m, n);
+                    mod_sub(x, ys, t, m, n);
+                    g = nontrivial_gcd(int_from_words(t, n), a);
+                }
+                goto done;
+            }
+            g = nontrivial_gcd(int_from_words(q, n), a);
+        }
+    }
+
+done:
+    free(buf);
+    barrett_destroy(&br);
+    return g;
+}
+
+// Lenstra's ECM on Montgomery curves 'B y^2 = x^3 + A x^2 + x', in projective 'X : Z' coordinates
+// (Montgomery, "Speeding the Pollard and elliptic curve methods of factorization", 1987). Stage 1
+// multiplies a point by all the prime powers up to 'B1'. Stage 2 then catches a single larger
+// prime up to 'B2' with the baby-step giant-step continuation: with 'Q' the point after stage 1,
+// '[k * W] Q = +-[d] Q' for some 'd' coprime to 'W' exactly when the order divides 'k * W -+ d'.
+
+enum {
+    // Stride of the giant steps of stage 2.
+    ECM_W = 2 * 3 * 5 * 7,
+    // First 'B1'; 'B2' is 'ECM_B2_RATIO * B1'.
+    ECM_B1_FIRST = 2000,
+    ECM_B2_RATIO = 50,
+};
+
+typedef struct {
+    deci_UWORD *x;
+    deci_UWORD *z;
+} EcmPoint;
+
+typedef struct {
+    Barrett br;
+    deci_UWORD *m;
+    size_t n;
+    // '(A + 2) / 4'.
+    deci_UWORD *a24;
+    deci_UWORD *t[3];
+    // The two points of the Montgomery ladder.
+    EcmPoint r0;
+    EcmPoint r1;
+    deci_UWORD *buf;
+} Ecm;
+
+static void ecm_init(Ecm *e, Number *a)
+{
+    size_t n = a->nwords;
+    e->m = a->words;
+    e->n = n;
+    barrett_init(&e->br, e->m, n);
+    e->buf = uu_xmalloc(uu_mul_zu_or_saturate(8, n), sizeof(deci_UWORD));
+    deci_UWORD *p = e->buf;
+    e->a24 = p;
+    for (int i = 0; i < 3; ++i)
+        e->t[i] = (p += n);
+    e->r0 = (EcmPoint) {.x = p + n, .z = p + 2 * n};
+    e->r1 = (EcmPoint) {.x = p + 3 * n, .z = p + 4 * n};
+}
+
+static void ecm_destroy(Ecm *e)
+{
+    free(e->buf);
+    barrett_destroy(&e->br);
+}
+
+static void ecm_point_copy(Ecm *e, EcmPoint src, EcmPoint dst)
+{
+    deci_memcpy(dst.x, src.x, e->n);
+    deci_memcpy(dst.z, src.z, e->n);
+}
+
+// 'out = 2 * p'; 'out' may be 'p'.
+static void ecm_dbl(Ecm *e, EcmPoint p, EcmPoint out)
+{
+    deci_UWORD *m = e->m;
+    size_t n = e->n;
+    deci_UWORD *t1 = e->t[0];
+    deci_UWORD *t2 = e->t[1];
+    deci_UWORD *t3 = e->t[2];
+    mod_add(p.x, p.z, t1, m, n);
+    barrett_mulmod(&e->br, t1, t1, t1);
+    mod_sub(p.x, p.z, t2, m, n);
+    barrett_mulmod(&e->br, t2, t2, t2);
+    mod_sub(t1, t2, t3, m, n);
+    barrett_mulmod(&e->br, t1, t2, out.x);
+    barrett_mulmod(&e->br, e->a24, t3, t1);
+    mod_add(t1, t2, t1, m, n);
+    barrett_mulmod(&e->br, t3, t1, out.z);
+}
+
+// 'out = p + q', where 'd = p - q'; 'out' may be 'p' or 'q', but not 'd'.
+static void ecm_add(Ecm *e, EcmPoint p, EcmPoint q, EcmPoint d, EcmPoint out)
+{
+    deci_UWORD *m = e->m;
+    size_t n = e->n;
+    deci_UWORD *t1 = e->t[0];
+    deci_UWORD *t2 = e->t[1];
+    deci_UWORD *t3 = e->t[2];
+    mod_sub(p.x, p.z, t1, m, n);
+    mod_add(q.x, q.z, t2, m, n);
+    barrett_mulmod(&e->br, t1, t2, t1);
+    mod_add(p.x, p.z, t2, m, n);
+    mod_sub(q.x, q.z, t3, m, n);
+    barrett_mulmod(&e->br, t2, t3, t2);
+    mod_add(t1, t2, t3, m, n);
+    barrett_mulmod(&e->br, t3, t3, t3);
+    mod_sub(t1, t2, t1, m, n);
+    barrett_mulmod(&e->br, t1, t1, t1);
+    barrett_mulmod(&e->br, d.z, t3, out.x);
+    barrett_mulmod(&e->br, d.x, t1, out.z);
+}
+
+// 'out = k * p' with the Montgomery ladder, 'k >= 1'; 'out' may be 'p'.
+static void ecm_mul(Ecm *e, EcmPoint p, uint64_t k, EcmPoint out)
+{
+    ecm_point_copy(e, p, e->r0);
+    ecm_dbl(e, p, e->r1);
+    for (int i = 62 - __builtin_clzll(k); i >= 0; --i) {
+        if ((k >> i) & 1) {
+            ecm_add(e, e->r0, e->r1, p, e->r0);
+            ecm_dbl(e, e->r1, e->r1);
+        } else {
+            ecm_add(e, e->r0, e->r1, p, e->r1);
+            ecm_dbl(e, e->r0, e->r0);
+        }
+    }
+    ecm_point_copy(e, e->r0, out);
+}
+
+// Sets up the curve and its starting point 'p' from Suyama's parametrization with 'sigma >= 6',
+// for which the group order is divisible by 12. Returns 'false' if that fails; then stores into
+// '*f' a factor of 'a' found on the way, or 'NULL'.
+//
+// Borrows (takes regular references to):
+//   * 'a'.
+static bool ecm_suyama(Ecm *e, Number *a, size_t sigma, EcmPoint p, Number **f)
+{
+    // 'u = sigma^2 - 5', 'v = 4 * sigma', 'x = u^3', 'z = v^3', and
+    // '(A + 2) / 4 = (v - u)^3 * (3 * u + v) / (16 * u^3 * v)'.
+    size_t u = sigma * sigma - 5;
+    size_t v = 4 * sigma;
+    Number *u3 = number_pow_zu(number_new_from_zu(u), 3);
+    Number *v3 = number_pow_zu(number_new_from_zu(v), 3);
+    Number *num = number_mul(
+        number_pow_zu(number_sub(number_new_from_zu(v), number_new_from_zu(u)), 3),
+        number_new_from_zu(3 * u + v));
+    value_ref((Value) u3);
+    Number *den = number_mul_uword(number_mul_uword(u3, v), 16);
+
+    value_ref((Value) den);
+    value_ref((Value) a);
+    Number *inv = number_mod_inverse(den, a);
+    if (!inv) {
+        *f = nontrivial_gcd(den, a);
+        value_unref((Value) num);
+        value_unref((Value) u3);
+        value_unref((Value) v3);
+        return false;
+    }
+    value_unref((Value) den);
+
+    int_to_words(int_mod(number_mul(num, inv), a), e->a24, e->n);
+    int_to_words(int_mod(u3, a), p.x, e->n);
+    int_to_words(int_mod(v3, a), p.z, e->n);
+    return true;
+}
+
+// Iterates over the primes from 2 on, up to '2^32'.
+typedef struct {
+    size_t i;
+    uint64_t p;
+} PrimeIter;
+
+static uint64_t prime_iter_next(PrimeIter *it)
+{
+    if (it->i < small_primes.np)
+        return it->p = small_primes.p[it->i++];
+    for (uint64_t x = it->p + 2;; x += 2) {
+        bool prime = true;
+        for (size_t j = 0; prime && (uint64_t) small_primes.p[j] * small_primes.p[j] <= x; ++j)
+            prime = x % small_primes.p[j] != 0;
+        if (prime)
+            return it->p = x;
+    }
+}
+
+// Runs one curve with the bounds 'b1' and 'b2'; returns a non-trivial factor of 'a' or 'NULL'.
+//
+// Borrows (takes regular references to):
+//   * 'a'.
+static Number *ecm_curve(Ecm *e, Number *a, size_t sigma, uint64_t b1, uint64_t b2)
+{
+    deci_UWORD *m = e->m;
+    size_t n = e->n;
+    Number *f = NULL;
+
+    // The baby steps '[d] Q' for the odd 'd < ECM_W / 2' coprime to 'ECM_W', followed by the
+    // giant step, the two last giant step points, the point of stage 1, the products 'X * Z' of
+    // the baby steps and of the current giant step point, and scratch space.
+    enum { NBABY = ECM_W / 4 };
+    size_t nw = 2 * (NBABY + 4) + NBABY + 3;
+    deci_UWORD *buf = uu_xmalloc(uu_mul_zu_or_saturate(nw, n), sizeof(deci_UWORD));
+    EcmPoint baby[NBABY];
+    for (size_t i = 0; i < NBABY; ++i)
+        baby[i] = (EcmPoint) {.x = buf + 2 * i * n, .z = buf + (2 * i + 1) * n};
+    deci_UWORD *w = buf + 2 * NBABY * n;
+    EcmPoint giant = {.x = w, .z = w + n};
+    EcmPoint prev = {.x = w + 2 * n, .z = w + 3 * n};
+    EcmPoint cur = {.x = w + 4 * n, .z = w + 5 * n};
+    EcmPoint q = {.x = w + 6 * n, .z = w + 7 * n};
+    deci_UWORD *xz = w + 8 * n;
+    deci_UWORD *xz_cur = xz + NBABY * n;
+    deci_UWORD *acc = xz_cur + n;
+    deci_UWORD *t = acc + n;
+
+    if (!ecm_suyama(e, a, sigma, q, &f))
+        goto done;
+
+    // Stage 1.
+    PrimeIter it = {0};
+    for (uint64_t p = prime_iter_next(&it); p <= b1; p = prime_iter_next(&it)) {
+        uint64_t pk = p;
+        while (pk <= b1 / p)
+            pk *= p;
+        ecm_mul(e, q, pk, q);
+    }
+    if ((f = nontrivial_gcd(int_from_words(q.z, n), a)))
+        goto done;
+
+    // Stage 2. The odd multiples of 'Q' are stepped through with the difference '[2] Q'; 'cur'
+    // and 'prev' are '[d] Q' and '[d - 2] Q', and 'giant' holds '[2] Q' meanwhile.
+    size_t nbaby = 0;
+    ecm_dbl(e, q, giant);
+    ecm_point_copy(e, q, cur);
+    ecm_point_copy(e, q, prev);
+    for (size_t d = 1; d < ECM_W / 2; d += 2) {
+        if (d % 3 && d % 5 && d % 7) {
+            ecm_point_copy(e, cur, baby[nbaby]);
+            barrett_mulmod(&e->br, cur.x, cur.z, xz + nbaby * n);
+            ++nbaby;
+        }
+        ecm_add(e, cur, giant, prev, e->r1);
+        ecm_point_copy(e, cur, prev);
+        ecm_point_copy(e, e->r1, cur);
+    }
+
+    uint64_t k0 = b1 / ECM_W;
+    uint64_t k1 = b2 / ECM_W + 1;
+    ecm_mul(e, q, ECM_W, giant);
+    ecm_mul(e, q, (k0 - 1) * ECM_W, prev);
+    ecm_mul(e, q, k0 * ECM_W, cur);
+    deci_zero_out_n(acc, n);
+    acc[0] = 1;
+    for (uint64_t k = k0; k <= k1; ++k) {
+        // 'X_R * Z_S - X_S * Z_R = (X_R - X_S) * (Z_R + Z_S) - X_R * Z_R + X_S * Z_S'.
+        barrett_mulmod(&e->br, cur.x, cur.z, xz_cur);
+        for (size_t i = 0; i < nbaby; ++i) {
+            mod_sub(cur.x, baby[i].x, t, m, n);
+            mod_add(cur.z, baby[i].z, e->r0.x, m, n);
+            barrett_mulmod(&e->br, t, e->r0.x, t);
+            mod_sub(t, xz_cur, t, m, n);
+            mod_add(t, xz + i * n, t, m, n);
+            barrett_mulmod(&e->br, acc, t, acc);
+        }
+        ecm_add(e, cur, giant, prev, e->r1);
+        ecm_point_copy(e, cur, prev);
+        ecm_point_copy(e, e->r1, cur);
+    }
+    f = nontrivial_gcd(int_from_words(acc, n), a);
+
+done:
+    free(buf);
+    return f;
+}
+
+// Returns a non-trivial factor of the composite 'a' of at least two words.
+//
+// Borrows (takes regular references to):
+//   * 'a'.
+static Number *ecm_factor(Number *a)
+{
+    Ecm e;
+    ecm_init(&e, a);
+    Number *f = NULL;
+    uint64_t b1 = ECM_B1_FIRST;
+    for (size_t sigma = 6; !f; ++sigma) {
+        f = ecm_curve(&e, a, sigma, b1, b1 * ECM_B2_RATIO);
+        if (b1 < UINT32_MAX / ECM_B2_RATIO / 2)
+            b1 += b1 / 16;
+    }
+    ecm_destroy(&e);
+    return f;
+}
+
+// If 'a' is 'r^k' for some 'k > 1', returns 'r' and stores 'k' into '*k'; otherwise returns
+// 'NULL'. 'a' must have no prime factors below 'SMALL_PRIME_LIMIT', so that 'k' is small.
+//
+// Borrows (takes regular references to):
+//   * 'a'.
+static Number *perfect_power_root(Number *a, size_t *k)
+{
+    double kmax = approx_log2(a) / 16;
+    for (size_t i = 0; small_primes.p[i] <= kmax; ++i) {
+        size_t p = small_primes.p[i];
+        value_ref((Value) a);
+        Number *r = number_iroot(a, p);
+        value_ref((Value) r);
+        Number *rp = number_pow_zu(r, p);
+        bool eq = number_compare(rp, a) == COMPARE_EQ;
+        value_unref((Value) rp);
+        if (eq) {
+            *k = p;
+            return r;
+        }
+        value_unref((Value) r);
+    }
+    return NULL;
+}
+
+// Returns a non-trivial factor of the composite 'a', which has no prime factors below
+// 'SMALL_PRIME_LIMIT' and is not a perfect power.
+//
+// Borrows (takes regular references to):
+//   * 'a'.
+static Number *find_factor(Number *a)
+{
+    if (a->nwords == 1)
+        return number_new_from_zu(word_rho(a->words[0]));
+    Number *f = multiword_rho(a);
+    if (!f)
+        f = ecm_factor(a);
+    return f;
+}
+
+static int factor_entry_compare(const void *x, const void *y)
+{
+    int r = number_compare(((const FactorEntry *) x)->p, ((const FactorEntry *) y)->p);
+    return r == COMPARE_LESS ? -1 : r == COMPARE_GREATER ? 1 : 0;
+}
+
+Number **number_factorize(Number *a, size_t *nfactors)
+{
+    FactorStack primes = {0};
+    FactorStack todo = {0};
+
+    // Trial division, on a copy of the words of 'a'.
+    a = int_abs(a);
+    size_t nw = a->nwords;
+    deci_UWORD *w = uu_xmemdup(a->words, nw * sizeof(deci_UWORD));
+    value_unref((Value) a);
+
+    small_primes_init();
+    bool cofactor_prime = false;
+    for (size_t i = 0; i < small_primes.ngroups; ++i) {
+        const SmallPrimeGroup *g = &small_primes.groups[i];
+        deci_UWORD p0 = small_primes.p[g->begin];
+        if (nw == 1 && w[0] / p0 < p0) {
+            // 'w' has no prime factors below 'p0', so it is either 1 or a prime.
+            cofactor_prime = true;
+            break;
+        }
+        deci_UWORD r = words_mod_word(w, nw, g->prod);
+        for (size_t j = g->begin; j < g->end; ++j) {
+            deci_UWORD p = small_primes.p[j];
+            if (r % p)
+                continue;
+            size_t mult = 0;
+            const WordDivisor *wd = word_divisor(p);
+            do {
+                (void) word_divisor_divmod(wd, w, nw, w, 0);
+                nw = deci_normalize_n(w, nw);
+                ++mult;
+            } while (words_mod_word(w, nw, p) == 0);
+            factor_stack_push(&primes, number_new_from_zu(p), mult);
+        }
+    }
+    Number *c = int_from_words(w, nw);
+    free(w);
+
+    if (number_abs_eq_uword(c, 1))
+        value_unref((Value) c);
+    else if (cofactor_prime)
+        factor_stack_push(&primes, c, 1);
+    else
+        factor_stack_push(&todo, c, 1);
+
+    while (todo.size) {
+        FactorEntry x = todo.data[--todo.size];
+        size_t k;
+        Number *r;
+        if (number_is_probable_prime(x.p, 25, /*seed=*/0x9E3779B97F4A7C15ULL)) {
+            factor_stack_push(&primes, x.p, x.mult);
+        } else if ((r = perfect_power_root(x.p, &k))) {
+            value_unref((Value) x.p);
+            factor_stack_push(&todo, r, x.mult * k);
+        } else {
+            Number *f = find_factor(x.p);
+            value_ref((Value) f);
+            factor_stack_push(&todo, number_idiv(x.p, f), x.mult);
+            factor_stack_push(&todo, f, x.mult);
+        }
+    }
+    free(todo.data);
+
+    if (primes.size)
+        qsort(primes.data, primes.size, sizeof(FactorEntry), factor_entry_compare);
+    size_t nr = 0;
+    for (size_t i = 0; i < primes.size; ++i)
+        nr += primes.data[i].mult;
+    Number **result = uu_xmalloc(nr, sizeof(Number *));
+    size_t j = 0;
+    for (size_t i = 0; i < primes.size; ++i) {
+        for (size_t k = primes.data[i].mult; k; --k) {
+            value_ref((Value) primes.data[i].p);
+            result[j++] = primes.data[i].p;
+        }
+        value_unref((Value) primes.data[i].p);
+    }
+    free(primes.data);
+
+    *nfactors = nr;
+    return result;
+}
+
+Number *number_smallest_prime_factor(Number *a)
+{
+    a = int_abs(a);
+
+    // Trial division stops at the first small prime factor, which is the smallest.
+    small_primes_init();
+    for (size_t i = 0; i < small_primes.ngroups; ++i) {
+        const SmallPrimeGroup *g = &small_primes.groups[i];
+        deci_UWORD p0 = small_primes.p[g->begin];
+        if (a->nwords == 1 && a->words[0] / p0 < p0)
+            return a;
+        deci_UWORD r = words_mod_word(a->words, a->nwords, g->prod);
+        for (size_t j = g->begin; j < g->end; ++j) {
+            deci_UWORD p = small_primes.p[j];
+            if (r % p == 0) {
+                value_unref((Value) a);
+                return number_new_from_zu(p);
+            }
+        }
+    }
+    if (number_is_probable_prime(a, 25, /*seed=*/0x9E3779B97F4A7C15ULL))
+        return a;
+
+    size_t nfactors;
+    Number **factors = number_factorize(a, &nfactors);
+    for (size_t i = 1; i < nfactors; ++i)
+        value_unref((Value) factors[i]);
+    Number *r = factors[0];
+    free(factors);
+    return r;
+}
+
+// Products and factorials. Long products are taken with a balanced product tree, so that the
+// multiplications near the root, which dominate, are between operands of similar sizes and get the
+// fast algorithms of 'fancy_mul()' (including the threaded one). Factors of less than a word are
+// first packed into whole words. A factorial or a binomial coefficient is built from its prime
+// factorization '\prod p^e': with 'P_j' the product of the primes that have bit 'j' set in their
+// exponent, it is '(...((P_J)^2 * P_(J-1))^2 ...)^2 * P_0', so that only 'log2(max e)' squarings
+// of a growing number are needed.
+
+enum {
+    // Products of at most this many words are taken one word at a time.
+    PRODUCT_LEAF = 16,
+    // 'C(n, k)' with 'n' below this, or with 'n <= CHOICE_SIEVE_RATIO * k', is computed from the
+    // primes up to 'n'; otherwise it is 'n * ... * (n - k + 1) / k!'.
+    CHOICE_SIEVE_MIN = 1 << 16,
+    CHOICE_SIEVE_RATIO = 32,
+};
+
+// Multiplies the consecutive values of 'w[0 ... n-1]', each below 'DECI_BASE', together while the
+// product fits a word; stores the products into 'w' and returns their number.
+static size_t pack_words(deci_UWORD *w, size_t n)
+{
+    if (!n)
+        return 0;
+    size_t nr = 0;
+    deci_UWORD cur = w[0];
+    for (size_t i = 1; i < n; ++i) {
+        if (cur > (DECI_BASE - 1) / w[i]) {
+            w[nr++] = cur;
+            cur = w[i];
+        } else {
+            cur *= w[i];
+        }
+    }
+    w[nr++] = cur;
+    return nr;
+}
+
+// Returns the product of the 'n' non-zero words 'w[0 ... n-1]'.
+static Number *words_product(deci_UWORD *w, size_t n)
+{
+    if (n <= PRODUCT_LEAF) {
+        Number *r = number_new_from_zu(1);
+        for (size_t i = 0; i < n; ++i)
+            r = number_mul_uword(r, w[i]);
+        return r;
+    }
+    size_t h = n / 2;
+    return number_mul(words_product(w, h), words_product(w + h, n - h));
+}
+
+// Returns '\prod p[i]^e[i]'; the 'p[i]' are non-zero words.
+static Number *prime_power_product(const deci_UWORD *p, const size_t *e, size_t np)
+{
+    size_t emax = 0;
+    for (size_t i = 0; i < np; ++i)
+        emax |= e[i];
+
+    int nbits = 0;
+    while (emax >> nbits)
+        ++nbits;
+
+    deci_UWORD *w = uu_xmalloc(np, sizeof(deci_UWORD));
+    Number *r = number_new_from_zu(1);
+    for (int j = nbits - 1; j >= 0; --j) {
+        value_ref((Value) r);
+        r = number_mul(r, r);
+        size_t nw = 0;
+        for (size_t i = 0; i < np; ++i)
+            if ((e[i] >> j) & 1)
+                w[nw++] = p[i];
+        nw = pack_words(w, nw);
+        r = number_mul(r, words_product(w, nw));
+    }
+    free(w);
+    return r;
+}
+
+// Returns a 'malloc()'ed array of the primes up to 'n', and stores their number into '*np'.
+static deci_UWORD *primes_up_to(size_t n, size_t *np)
+{
+    bool *composite = uu_xcalloc(uu_add_zu_or_saturate(n, 1), sizeof(bool));
+    size_t nr = 0;
+    for (size_t i = 2; i <= n; ++i) {
+        if (composite[i])
+            continue;
+        ++nr;
+        if (i <= n / i)
+            for (size_t j = i * i; j <= n; j += i)
+                composite[j] = true;
+    }
+    deci_UWORD *r = uu_xmalloc(nr, sizeof(deci_UWORD));
+    size_t k = 0;
+    for (size_t i = 2; i <= n; ++i)
+        if (!composite[i])
+            r[k++] = i;
+    free(composite);
+    *np = nr;
+    return r;
+}
+
+// Exponent of the prime 'p' in 'n!' (Legendre's formula).
+static size_t legendre(size_t n, size_t p)
+{
+    size_t e = 0;
+    for (n /= p; n; n /= p)
+        e += n;
+    return e;
+}
+
+Number *number_product(Number **xs, size_t n)
+{
+    if (!n)
+        return number_new_from_zu(1);
+    if (n == 1)
+        return xs[0];
+    size_t h = n / 2;
+    return number_mul(number_product(xs, h), number_product(xs + h, n - h));
+}
+
+Number *number_factorial(size_t n)
+{
+    // '20! < DECI_BASE'.
+    if (n <= 20) {
+        deci_UWORD r = 1;
+        for (size_t i = 2; i <= n; ++i)
+            r *= i;
+        return number_new_from_zu(r);
+    }
+
+    size_t np;
+    deci_UWORD *p = primes_up_to(n, &np);
+    size_t *e = uu_xmalloc(np, sizeof(size_t));
+    for (size_t i = 0; i < np; ++i)
+        e[i] = legendre(n, p[i]);
+    Number *r = prime_power_product(p, e, np);
+    free(e);
+    free(p);
+    return r;
+}
+
+Number *number_choice(Number *n, size_t k)
+{
+    size_t nn = number_to_zu(n);
+    if (nn != SIZE_MAX && (nn < CHOICE_SIEVE_MIN || nn / CHOICE_SIEVE_RATIO <= k)) {
+        value_unref((Value) n);
+        if (k > nn)
+            return number_new_from_zu(0);
+        if (k > nn - k)
+            k = nn - k;
+
+        // The exponent of 'p' is the number of carries when adding 'k' and 'n - k' in base 'p'
+        // (Kummer's theorem), so only the primes up to 'n' take part.
+        size_t np;
+        deci_UWORD *p = primes_up_to(nn, &np);
+        size_t *e = uu_xmalloc(np, sizeof(size_t));
+        for (size_t i = 0; i < np; ++i)
+            e[i] = legendre(nn, p[i]) - legendre(k, p[i]) - legendre(nn - k, p[i]);
+        Number *r = prime_power_product(p, e, np);
+        free(e);
+        free(p);
+        return r;
+    }
+
+    // Here 'n > k'.
+    Number *num;
+    if (nn < DECI_BASE) {
+        deci_UWORD *w = uu_xmalloc(k, sizeof(deci_UWORD));
+        for (size_t i = 0; i < k; ++i)
+            w[i] = nn - i;
+        num = words_product(w, pack_words(w, k));
+        free(w);
+        value_unref((Value) n);
+    } else {
+        Number **xs = uu_xmalloc(k, sizeof(Number *));
+        for (size_t i = 0; i < k; ++i) {
+            value_ref((Value) n);
+            xs[i] = number_sub(n, number_new_from_zu(i));
+        }
+        num = number_product(xs, k);
+        free(xs);
+        value_unref((Value) n);
+    }
+    return number_idiv(num, number_factorial(k));
+}
+
+// Constants. Each is the sum of a series
+//
+//     \sum_k a(k) * (p(0) ... p(k)) / (q(0) ... q(k))
+//
+// with small integers 'a(k)', 'p(k)' and 'q(k)', found by binary splitting: for the terms '[i, j)',
+// the integers
+//
+//     P = p(i) ... p(j-1),    Q = q(i) ... q(j-1),
+//     T = Q * \sum_{k=i}^{j-1} a(k) * (p(i) ... p(k)) / (q(i) ... q(k))
+//
+// of '[i, m)' and '[m, j)' combine into those of '[i, j)' as 'P = P1 P2', 'Q = Q1 Q2' and
+// 'T = Q2 T1 + P1 T2'. The sum is then 'T / Q', a single division at the end. As with products,
+// the work is dominated by the multiplications near the root of the tree, which are between
+// numbers of similar sizes. Constants are computed with a guard word and then truncated.
+
+// '640320^3 / 24 = 26680 * 640320^2', in factors that fit into a word of any width.
+enum {
+    CHUDNOVSKY_C_24 = 26680,
+    CHUDNOVSKY_C = 640320,
+};
+
+// 'log10(640320^3 / 1728)', the number of digits each term of the Chudnovsky series adds.
+static const double CHUDNOVSKY_DIGITS_PER_TERM = 14.181647462725477;
+
+// 'log2(10)'.
+static const double LOG2_10 = 3.321928094887362;
+
+typedef struct {
+    // Stores 'p(k)', 'q(k)' and 'a(k)' into '*p', '*q' and '*a'; 'NULL' may be stored into '*p',
+    // standing for one.
+    void (*term)(const void *ctx, size_t k, Number **p, Number **q, Number **a);
+    const void *ctx;
+    // Each 'q(k)' carries a further factor of '10^shift', which is kept out of 'Q': 'T' gets it as
+    // 'T = 10^(shift * (j - m)) Q2 T1 + P1 T2' instead.
+    size_t shift;
+} Series;
+
+typedef struct {
+    // May be 'NULL', standing for one.
+    Number *p;
+    Number *q;
+    Number *t;
+} SeriesSplit;
+
+// Steals (takes move references to):
+//   * 'a' (if not 'NULL');
+//   * 'b' (if not 'NULL').
+//
+// 'NULL' stands for one.
+static Number *mul_opt(Number *a, Number *b)
+{
+    if (!a)
+        return b;
+    if (!b)
+        return a;
+    return number_mul(a, b);
+}
+
+static Number *ref_opt(Number *a)
+{
+    if (a)
+        value_ref((Value) a);
+    return a;
+}
+
+// Splits the terms '[i, j)' of 's'; 'P' is only computed if 'need_p' (otherwise it is 'NULL').
+static SeriesSplit series_split(const Series *s, size_t i, size_t j, bool need_p)
+{
+    SeriesSplit r;
+    if (j - i == 1) {
+        Number *a;
+        s->term(s->ctx, i, &r.p, &r.q, &a);
+        if (need_p) {
+            r.t = mul_opt(a, ref_opt(r.p));
+        } else {
+            r.t = mul_opt(a, r.p);
+            r.p = NULL;
+        }
+        return r;
+    }
+
+    size_t m = i + (j - i) / 2;
+    SeriesSplit x = series_split(s, i, m, true);
+    SeriesSplit y = series_split(s, m, j, need_p);
+
+    value_ref((Value) y.q);
+    Number *t1 = number_mul(y.q, x.t);
+    if (s->shift)
+        t1 = number_scale_up(t1, uu_mul_zu_or_saturate(s->shift, j - m));
+    Number *t2 = mul_opt(need_p ? ref_opt(x.p) : x.p, y.t);
+    r.t = number_add(t1, t2);
+    r.p = need_p ? mul_opt(x.p, y.p) : NULL;
+    r.q = number_mul(x.q, y.q);
+    return r;
+}
+
+// Drops the same number of low words from the integers '*x' and '*y' ('*y' non-zero), so that '*y'
+// keeps at most 'n' words. This changes '*x / *y' by less than '(|*x / *y| + 1) * DECI_BASE^(1-n)';
+// the numerator and the denominator of a sum are typically much longer than the precision wanted.
+static void shorten_ratio(Number **x, Number **y, size_t n)
+{
+    size_t ny = (*y)->nwords;
+    if (ny <= n)
+        return;
+    size_t ndigits = uu_mul_zu_or_saturate(ny - n, DECI_BASE_LOG);
+    *x = number_trunc(number_scale_down(*x, ndigits));
+    *y = number_trunc(number_scale_down(*y, ndigits));
+}
+
+// Returns the sum of the first 'n' ('n >= 1') terms of 's', truncated to 'ntp'; the sum must be
+// below 'DECI_BASE' in absolute value, and is accurate to a few units of the last word.
+static Number *series_sum(const Series *s, size_t n, NumberTruncateParams ntp)
+{
+    SeriesSplit r = series_split(s, 0, n, false);
+    shorten_ratio(&r.t, &r.q, uu_add_zu_or_saturate(ntp.scale, 2));
+    if (s->shift)
+        r.t = number_scale_down(r.t, uu_mul_zu_or_saturate(s->shift, n));
+    return number_div(r.t, r.q, ntp);
+}
+
+// The precision to compute a constant with before truncating it to 'ntp': one guard word more.
+static inline NumberTruncateParams constant_ntp(NumberTruncateParams ntp)
+{
+    return (NumberTruncateParams) {.scale = uu_add_zu_or_saturate(ntp.scale, 1), .submod = 1};
+}
+
+// Chudnovsky's series:
+//
+//     1/pi = 12 / 640320^(3/2) * \sum_k (-1)^k (6k)! (13591409 + 545140134k) / D(k),
+//     D(k) = (3k)! (k!)^3 640320^(3k).
+static void chudnovsky_term(const void *ctx, size_t k, Number **p, Number **q, Number **a)
+{
+    (void) ctx;
+    if (k) {
+        *p = number_negate(number_mul_uword(
+            number_mul_uword(number_new_from_zu(6 * k - 5), 2 * k - 1),
+            6 * k - 1));
+        Number *k3 = number_mul_uword(number_mul_uword(number_new_from_zu(k), k), k);
+        *q = number_mul_uword(
+            number_mul_uword(number_mul_uword(k3, CHUDNOVSKY_C_24), CHUDNOVSKY_C),
+            CHUDNOVSKY_C);
+    } else {
+        *p = NULL;
+        *q = number_new_from_zu(1);
+    }
+    *a = number_abs_add_uword(number_mul_uword(number_new_from_zu(k), 545140134), 13591409);
+}
+
+// 'e = \sum_k 1 / k!'.
+static void e_term(const void *ctx, size_t k, Number **p, Number **q, Number **a)
+{
+    (void) ctx;
+    *p = NULL;
+    *q = number_new_from_zu(k ? k : 1);
+    *a = number_new_from_zu(1);
+}
+
+// 'atanh(1/m) = \sum_k 1 / ((2k + 1) m^(2k + 1))'; 'ctx' points to 'm'.
+static void atanh_inv_term(const void *ctx, size_t k, Number **p, Number **q, Number **a)
+{
+    deci_UWORD m = *(const deci_UWORD *) ctx;
+    if (k) {
+        *p = number_new_from_zu(2 * k - 1);
+        *q = number_mul_uword(number_new_from_zu(2 * k + 1), m * m);
+    } else {
+        *p = NULL;
+        *q = number_new_from_zu(m);
+    }
+    *a = number_new_from_zu(1);
+}
+
+// 'atanh(1/m)' truncated to 'ntp', for '2 <= m < 2^32'.
+static Number *atanh_inv(deci_UWORD m, NumberTruncateParams ntp)
+{
+    Series s = {atanh_inv_term, &m, 0};
+    size_t n = ntp_to_prec(ntp) * LOG2_10 / (2 * approx_log2_double(m)) + 2;
+    return series_sum(&s, n, ntp);
+}
+
+Number *number_pi(NumberTruncateParams ntp)
+{
+    NumberTruncateParams g = constant_ntp(ntp);
+    Series s = {chudnovsky_term, NULL, 0};
+    size_t n = ntp_to_prec(g) / CHUDNOVSKY_DIGITS_PER_TERM + 2;
+    SeriesSplit r = series_split(&s, 0, n, false);
+
+    // 'pi = 426880 sqrt(10005) Q / T'.
+    shorten_ratio(&r.q, &r.t, uu_add_zu_or_saturate(g.scale, 2));
+    Number *x = number_mul(
+        number_mul_uword(r.q, 426880),
+        number_root(number_new_from_zu(10005), 2, g));
+    return number_truncate(number_div(x, r.t, g), ntp);
+}
+
+Number *number_e(NumberTruncateParams ntp)
+{
+    NumberTruncateParams g = constant_ntp(ntp);
+    Series s = {e_term, NULL, 0};
+
+    // The first 'n' such that 'n! > 10^prec'.
+    double nbits = ntp_to_prec(g) * LOG2_10;
+    size_t n = 1;
+    for (double lg = 0; lg <= nbits;)
+        lg += approx_log2_double(++n);
+
+    return number_truncate(series_sum(&s, n + 1, g), ntp);
+}
+
+Number *number_ln2(NumberTruncateParams ntp)
+{
+    NumberTruncateParams g = constant_ntp(ntp);
+
+    // 'ln 2 = 18 atanh(1/26) - 2 atanh(1/4801) + 8 atanh(1/8749)'.
+    Number *r = number_mul_uword(atanh_inv(26, g), 18);
+    r = number_sub(r, number_mul_uword(atanh_inv(4801, g), 2));
+    r = number_add(r, number_mul_uword(atanh_inv(8749, g), 8));
+    return number_truncate(r, ntp);
+}
+
+// Exponentials and logarithms. 'exp(a)' is 'exp(a / 2^s)^(2^s)' with 'a / 2^s < 1', and the
+// exponential of 'r = a / 2^s' is found with the bit-burst method: 'r' is cut into pieces
+// 'r_j = c_j / 10^d_j' of doubling lengths, 'd_0 = BURST_FIRST_PIECE' and 'd_(j+1) = 2 d_j', and
+// 'exp(r) = \prod exp(r_j)', with each 'exp(r_j)' summed by binary splitting. Since 'r_j' is below
+// '10^(-d_(j-1))', the longer a piece, the fewer terms its series needs, and every piece costs
+// about the same. The squarings lose 's' bits of relative precision, and the integer digits of
+// the result need to be exact too, so both are added to the working precision.
+//
+// 'ln a' is 'm ln 2 + ln y' with 'a = 2^m y' and 'y' close to one; 'ln y' is refined from a
+// floating-point estimate with Newton's iteration 'z' = z + y exp(-z) - 1', which doubles the
+// number of correct digits, so each step is done at twice the precision of the previous one and
+// the work is dominated by the last one or two exponentials.
+
+enum {
+    // Number of decimal digits in the first piece of a bit-burst argument.
+    BURST_FIRST_PIECE = 8,
+};
+
+// 'log2(e)'.
+static const double LOG2_E = 1.4426950408889634;
+
+// Approximate value of 'a', saturated at about '10^300' in absolute value.
+static double approx_double(Number *a)
+{
+    double r;
+    if (a->nwords - a->scale > 15) {
+        r = 1e300;
+    } else {
+        r = 0;
+        for (size_t i = a->nwords; i > a->scale; --i)
+            r = r * DECI_BASE + a->words[i - 1];
+        if (a->scale)
+            r += (double) a->words[a->scale - 1] / DECI_BASE;
+    }
+    return a->sign ? -r : r;
+}
+
+// Approximate 'log2(a)' for a positive 'a'.
+static double approx_log2_frac(Number *a)
+{
+    size_t i = a->nwords;
+    while (!a->words[i - 1])
+        --i;
+    double v = a->words[i - 1];
+    if (i == 1)
+        return approx_log2_double(v) - (double) a->scale * LOG2_BASE;
+    v = v * DECI_BASE + a->words[i - 2];
+    return approx_log2_double(v) + ((double) i - 2 - (double) a->scale) * LOG2_BASE;
+}
+
+typedef struct {
+    Number *r;
+    // 'floor(r * 10^d1)'.
+    Number *prev;
+    size_t ndigits;
+    // The current piece is 'c / 10^d1', and is below '10^(-d0)'.
+    size_t d0;
+    size_t d1;
+} BurstIter;
+
+// Starts cutting 'r' ('0 <= r < 1') into pieces.
+//
+// Steals (takes move references to):
+//   * 'r'.
+static BurstIter burst_begin(Number *r)
+{
+    return (BurstIter) {
+        .r = r,
+        .prev = number_new_from_zu(0),
+        .ndigits = uu_mul_zu_or_saturate(r->scale, DECI_BASE_LOG),
+        .d0 = 0,
+        .d1 = 0,
+    };
+}
+
+// Returns the 'c' of the next non-zero piece, or 'NULL' (and frees the iterator) if there are no
+// more pieces.
+static Number *burst_next(BurstIter *it)
+{
+    while (it->d1 < it->ndigits) {
+        it->d0 = it->d1;
+        it->d1 = it->d0 ? it->d0 * 2 : BURST_FIRST_PIECE;
+        if (it->d1 > it->ndigits)
+            it->d1 = it->ndigits;
+
+        value_ref((Value) it->r);
+        Number *cur = number_trunc(number_scale_up(it->r, it->d1));
+        value_ref((Value) cur);
+        Number *c = number_sub(cur, number_scale_up(it->prev, it->d1 - it->d0));
+        it->prev = cur;
+        if (!number_is_zero(c))
+            return c;
+        value_unref((Value) c);
+    }
+    value_unref((Value) it->prev);
+    value_unref((Value) it->r);
+    return NULL;
+}
+
+// 'exp(r) - 1 = \sum_k r^(k + 1) / (k + 1)!' for 'r = c / 10^shift'; 'ctx' points to 'c'.
+static void exp_piece_term(const void *ctx, size_t k, Number **p, Number **q, Number **a)
+{
+    Number *c = *(Number *const *) ctx;
+    value_ref((Value) c);
+    *p = c;
+    *q = number_new_from_zu(k + 1);
+    *a = number_new_from_zu(1);
+}
+
+// 'exp(r)' for '0 <= r < 1' truncated to 'ntp', with an error of a few units of the last word.
+//
+// Steals (takes move references to):
+//   * 'r'.
+static Number *exp_frac(Number *r, NumberTruncateParams ntp)
+{
+    NumberTruncateParams g = {.scale = uu_add_zu_or_saturate(ntp.scale, 1), .submod = 1};
+    double nbits = ntp_to_prec(g) * LOG2_10;
+
+    Number *y = number_new_from_zu(1);
+    BurstIter it = burst_begin(r);
+    Number *c;
+    while ((c = burst_next(&it))) {
+        // The 'n'-th term is below '10^(-d0 n) / n!'.
+        size_t n = 0;
+        for (double lg = 0; lg <= nbits;)
+            lg += it.d0 * LOG2_10 + approx_log2_double(++n);
+
+        Series s = {exp_piece_term, &c, it.d1};
+        Number *e = number_abs_add_uword(series_sum(&s, n, g), 1);
+        value_unref((Value) c);
+        y = number_truncate(number_mul(y, e), g);
+    }
+    return number_truncate(y, ntp);
+}
+
+// 'exp(a)' truncated to 'ntp', with an error of a few units of the last word.
+//
+// Steals (takes move references to):
+//   * 'a'.
+static Number *exp_approx(Number *a, NumberTruncateParams ntp)
+{
+    if (number_is_zero(a)) {
+        value_unref((Value) a);
+        return number_new_from_zu(1);
+    }
+    bool neg = a->sign;
+    if (neg)
+        a = number_negate(a);
+
+    value_ref((Value) a);
+    Number *ia = number_trunc(a);
+    size_t s = number_is_zero(ia) ? 0 : zu_from_double(approx_log2(ia)) + 2;
+    value_unref((Value) ia);
+
+    // 'exp(a)' has about 'a log10(e)' integer digits, and the squarings multiply the relative error
+    // by '2^s'.
+    size_t nint = zu_from_double(approx_double(a) * LOG2_E / LOG2_BASE) + 1;
+    size_t nloss = s / 60 + 1;
+    NumberTruncateParams w = {
+        .scale = uu_add_zu_or_saturate(uu_add_zu_or_saturate(ntp.scale, nint), nloss),
+        .submod = 1,
+    };
+
+    Number *y = exp_frac(number_div(a, number_pow_zu(number_new_from_zu(2), s), w), w);
+    for (size_t i = 0; i < s; ++i) {
+        value_ref((Value) y);
+        y = number_truncate(number_mul(y, y), w);
+    }
+    if (neg)
+        return number_div(number_new_from_zu(1), y, ntp);
+    return number_truncate(y, ntp);
+}
+
+enum {
+    // Bound on the error of 'exp_approx()' and of the results computed from it, in units of the
+    // last word.
+    APPROX_ERR_UNITS = 4,
+};
+
+// 'n' units of the last word of 'ntp'.
+static Number *last_word_units(size_t n, NumberTruncateParams ntp)
+{
+    return number_scale_down(
+        number_new_from_zu(n),
+        uu_mul_zu_or_saturate(ntp.scale, DECI_BASE_LOG));
+}
+
+// Whether a value within 'APPROX_ERR_UNITS' units of the last word of 'g' of 'r' can truncate to
+// 'ntp' differently from another such value.
+//
+// Borrows (takes regular references to):
+//   * 'r'.
+static bool truncation_unsure(Number *r, NumberTruncateParams g, NumberTruncateParams ntp)
+{
+    Number *eps = last_word_units(APPROX_ERR_UNITS, g);
+    value_ref((Value) r);
+    value_ref((Value) eps);
+    Number *lo = number_truncate(number_sub(r, eps), ntp);
+    value_ref((Value) r);
+    Number *hi = number_truncate(number_add(r, eps), ntp);
+    bool same = (number_is_zero(lo) && number_is_zero(hi)) || number_compare(lo, hi) == COMPARE_EQ;
+    value_unref((Value) lo);
+    value_unref((Value) hi);
+    return !same;
+}
+
+// Whether 'exp(a)' is below the unit of 'ntp' by more than a word, so that it truncates to zero.
+//
+// Borrows (takes regular references to):
+//   * 'a'.
+static bool exp_underflows(Number *a, NumberTruncateParams ntp)
+{
+    double bound = (ntp_to_prec(ntp) + (double) DECI_BASE_LOG) * LOG2_10 / LOG2_E;
+    return a->sign && -approx_double(a) > bound;
+}
+
+Number *number_exp(Number *a, NumberTruncateParams ntp)
+{
+    if (number_is_zero(a)) {
+        value_unref((Value) a);
+        return number_new_from_zu(1);
+    }
+    // 'exp_approx()' would compute 'exp(|a|)' first, which may not even fit in memory.
+    if (exp_underflows(a, ntp)) {
+        value_unref((Value) a);
+        return number_new_from_zu(0);
+    }
+
+    // 'exp(a)' is never a multiple of the unit of 'ntp' for a non-zero 'a', so guard words tell
+    // which way it truncates; as many as 'a' has are taken to be enough.
+    size_t max_nguard = uu_add_zu_or_saturate(a->nwords, 2);
+    for (size_t nguard = 1;; nguard = uu_mul_zu_or_saturate(nguard, 2)) {
+        NumberTruncateParams g = {
+            .scale = uu_add_zu_or_saturate(ntp.scale, nguard),
+            .submod = 1,
+        };
+        value_ref((Value) a);
+        Number *r = exp_approx(a, g);
+        if (nguard >= max_nguard || !truncation_unsure(r, g, ntp)) {
+            value_unref((Value) a);
+            return number_truncate(r, ntp);
+        }
+        value_unref((Value) r);
+    }
+}
+
+// Refines the estimate 'z' of 'ln y' so that it is accurate to about 'scale' words.
+//
+// Borrows (takes regular references to):
+//   * 'y'.
+//
+// Steals (takes move references to):
+//   * 'z'.
+static Number *ln_newton(Number *y, Number *z, size_t scale)
+{
+    if (scale > 1)
+        z = ln_newton(y, z, scale > 2 ? scale / 2 + 1 : 1);
+
+    NumberTruncateParams w = {.scale = scale + 1, .submod = 1};
+    value_ref((Value) z);
+    value_ref((Value) y);
+    Number *t = number_mul(number_truncate(y, w), exp_approx(number_negate(z), w));
+    return number_truncate(number_sub(number_add(z, t), number_new_from_zu(1)), w);
+}
+
+// 'ln a' for a positive 'a', truncated to 'ntp' with an error of a few units of the last word.
+//
+// Steals (takes move references to):
+//   * 'a'.
+static Number *ln_approx(Number *a, State *state, NumberTruncateParams ntp)
+{
+    size_t scale = uu_add_zu_or_saturate(ntp.scale, 1);
+    NumberTruncateParams w = {.scale = uu_add_zu_or_saturate(scale, 1), .submod = 1};
+
+    // 'a = 2^m y' (or '2^(-m) y' if 'mneg').
+    double lg = approx_log2_frac(a);
+    bool mneg = lg < 0;
+    size_t m = zu_from_double((mneg ? -lg : lg) + 0.5);
+    Number *pm = number_pow_zu(number_new_from_zu(2), m);
+    Number *y;
+    if (mneg)
+        y = number_mul(a, pm);
+    else
+        y = number_div(a, pm, w);
+
+    // The estimate is good to about 40 bits.
+    double z0 = (lg - (mneg ? -(double) m : (double) m)) / LOG2_E;
+    size_t zi = zu_from_double((z0 < 0 ? -z0 : z0) * 1e15);
+    Number *z = number_scale_down(number_new_from_zu(zi), 15);
+    if (z0 < 0)
+        z = number_negate(z);
+    z = ln_newton(y, z, scale);
+    value_unref((Value) y);
+
+    Number *mln2 = number_mul(
+        (Number *) state_get_const(state, STATE_CONST_LN2, w),
+        number_new_from_zu(m));
+    if (mneg)
+        mln2 = number_negate(mln2);
+    return number_truncate(number_add(mln2, z), ntp);
+}
+
+Number *number_ln(Number *a, State *state, NumberTruncateParams ntp)
+{
+    if (number_abs_eq_uword(a, 1)) {
+        value_unref((Value) a);
+        return number_new_from_zu(0);
+    }
+
+    // 'ln a' is never a multiple of the unit of 'ntp' for 'a != 1', so guard words tell which way
+    // it truncates. Near one, it differs from 'a - 1' by about '(a - 1)^2', so as many guard words
+    // as that has are taken to be enough.
+    size_t max_nguard = uu_add_zu_or_saturate(uu_mul_zu_or_saturate(a->nwords, 2), 2);
+    for (size_t nguard = 1;; nguard = uu_mul_zu_or_saturate(nguard, 2)) {
+        NumberTruncateParams g = {
+            .scale = uu_add_zu_or_saturate(ntp.scale, nguard),
+            .submod = 1,
+        };
+        value_ref((Value) a);
+        Number *r = ln_approx(a, state, g);
+        if (nguard >= max_nguard || !truncation_unsure(r, g, ntp)) {
+            value_unref((Value) a);
+            return number_truncate(r, ntp);
+        }
+        value_unref((Value) r);
+    }
+}
+
+enum {
+    // Largest size, in words, of the powers 'pow_is_exact()' compares.
+    POW_EXACT_MAX_WORDS = 4096,
+};
+
+// Whether 'b^e' is exactly 't', for positive 'b' and 't'; 'false' if the powers that tell it would
+// be longer than 'POW_EXACT_MAX_WORDS'.
+//
+// Borrows (takes regular references to):
+//   * 'b';
+//   * 'e';
+//   * 't'.
+static bool pow_is_exact(Number *b, Number *e, Number *t)
+{
+    // With 'e = p / q' in lowest terms, 'b^e = t' if and only if 'b^p = t^q'.
+    size_t nd = uu_mul_zu_or_saturate(e->scale, DECI_BASE_LOG);
+    value_ref((Value) e);
+    Number *p = number_trunc(number_scale_up(e, nd));
+    Number *q = number_scale_up(number_new_from_zu(1), nd);
+    value_ref((Value) p);
+    value_ref((Value) q);
+    Number *d = number_gcd(p, q);
+    value_ref((Value) d);
+    p = number_idiv(p, d);
+    q = number_idiv(q, d);
+
+    bool pneg = p->sign;
+    size_t zp = number_to_zu(pneg ? number_negate(p) : p);
+    size_t zq = number_to_zu(q);
+    value_unref((Value) p);
+    value_unref((Value) q);
+    if (uu_mul_zu_or_saturate(zp, b->nwords) > POW_EXACT_MAX_WORDS ||
+        uu_mul_zu_or_saturate(zq, t->nwords) > POW_EXACT_MAX_WORDS)
+    {
+        return false;
+    }
+
+    value_ref((Value) b);
+    value_ref((Value) t);
+    Number *x = number_pow_zu(b, zp);
+    Number *y = number_pow_zu(t, zq);
+    if (pneg) {
+        // 'b^(-|p|) = t^q' if and only if 'b^|p| t^q = 1'.
+        x = number_mul(x, y);
+        y = number_new_from_zu(1);
+    }
+    bool r = number_compare(x, y) == COMPARE_EQ;
+    value_unref((Value) x);
+    value_unref((Value) y);
+    return r;
+}
+
+Number *number_pow_real(Number *b, Number *e, State *state, NumberTruncateParams ntp)
+{
+    // An error in 'ln b' is multiplied by 'e', and then becomes the relative error of the result,
+    // so 'ln b' needs a word more for each integer word of 'e' and of the result.
+    double nbits = approx_log2_frac(b) * approx_double(e);
+    size_t nres = nbits > 0 ? zu_from_double(nbits / LOG2_BASE) + 1 : 0;
+    size_t ne = e->nwords - e->scale;
+
+    // If a multiple of the unit of 'ntp' is within the error of the result, it is the result if the
+    // power is exact, as '4 ** 0.5' is; otherwise more guard words tell which side of it the result
+    // is on, up to as many as the operands have.
+    size_t max_nguard = uu_add_zu_or_saturate(uu_add_zu_or_saturate(b->nwords, e->nwords), 2);
+    bool checked_exact = false;
+    for (size_t nguard = 1;; nguard = uu_mul_zu_or_saturate(nguard, 2)) {
+        NumberTruncateParams w = {
+            .scale = uu_add_zu_or_saturate(
+                uu_add_zu_or_saturate(ntp.scale, nres),
+                uu_add_zu_or_saturate(ne, nguard + 1)),
+            .submod = 1,
+        };
+        NumberTruncateParams g = {
+            .scale = uu_add_zu_or_saturate(ntp.scale, nguard),
+            .submod = 1,
+        };
+        value_ref((Value) b);
+        value_ref((Value) e);
+        Number *x = number_mul(e, ln_approx(b, state, w));
+        if (exp_underflows(x, ntp)) {
+            value_unref((Value) x);
+            value_unref((Value) b);
+            value_unref((Value) e);
+            return number_new_from_zu(0);
+        }
+        Number *r = exp_approx(x, g);
+
+        bool done = nguard >= max_nguard || !truncation_unsure(r, g, ntp);
+        if (!done && !checked_exact) {
+            checked_exact = true;
+            value_ref((Value) r);
+            Number *t = number_truncate(number_add(r, last_word_units(APPROX_ERR_UNITS, g)), ntp);
+            if (pow_is_exact(b, e, t)) {
+                value_unref((Value) r);
+                r = t;
+                done = true;
+            } else {
+                value_unref((Value) t);
+            }
+        }
+        if (done) {
+            value_unref((Value) b);
+            value_unref((Value) e);
+            return number_truncate(r, ntp);
+        }
+        value_unref((Value) r);
+    }
+}
+
+// Trigonometric functions. The argument is reduced to 'r = a - k pi/2' with '|r| <= pi/4', which
+// takes 'pi' to as many more words as 'a' has integer words, and 'sin r' and 'cos r' are found
+// together with the bit-burst method, as 'exp' is: with 'r = \sum r_j', the pieces are combined
+// with the angle addition formulas, and the sine and the cosine of each are summed by binary
+// splitting.
+//
+// 'atan x' is refined from 'x' (or from 'pi/2 - atan(1/x)' for '|x| > 1') with Newton's iteration
+// for 'tan z = x', 'z' = z - cos z (sin z - x cos z)', which doubles the number of correct digits,
+// so, as with 'ln', each step is done at twice the precision of the previous one.
+
+// 'sin(r) / r - 1 = \sum_k (-r^2)^(k + 1) / (2k + 3)!' for 'r = c / 10^(shift / 2)'; 'ctx' points
+// to '-c^2'.
+static void sin_piece_term(const void *ctx, size_t k, Number **p, Number **q, Number **a)
+{
+    Number *mc2 = *(Number *const *) ctx;
+    value_ref((Value) mc2);
+    *p = mc2;
+    *q = number_mul_uword(number_new_from_zu(2 * k + 2), 2 * k + 3);
+    *a = number_new_from_zu(1);
+}
+
+// 'cos(r) - 1 = \sum_k (-r^2)^(k + 1) / (2k + 2)!', the same way.
+static void cos_piece_term(const void *ctx, size_t k, Number **p, Number **q, Number **a)
+{
+    Number *mc2 = *(Number *const *) ctx;
+    value_ref((Value) mc2);
+    *p = mc2;
+    *q = number_mul_uword(number_new_from_zu(2 * k + 1), 2 * k + 2);
+    *a = number_new_from_zu(1);
+}
+
+// Stores 'sin r' and 'cos r' for '|r| < 1', truncated to 'ntp' with an error of a few units of the
+// last word, into '*s' and '*c'.
+//
+// Steals (takes move references to):
+//   * 'r'.
+static void sin_cos_frac(Number *r, NumberTruncateParams ntp, Number **s, Number **c)
+{
+    NumberTruncateParams g = constant_ntp(ntp);
+    double nbits = ntp_to_prec(g) * LOG2_10;
+
+    bool neg = r->sign;
+    if (neg)
+        r = number_negate(r);
+
+    Number *ys = number_new_from_zu(0);
+    Number *yc = number_new_from_zu(1);
+    BurstIter it = burst_begin(r);
+    Number *p;
+    while ((p = burst_next(&it))) {
+        // The 'n'-th terms are below '10^(-2 d0 n) / (2n)!'.
+        size_t n = 0;
+        for (double lg = 0; lg <= nbits; ++n) {
+            lg += 2 * it.d0 * LOG2_10;
+            lg += approx_log2_double(2 * n + 1) + approx_log2_double(2 * n + 2);
+        }
+
+        value_ref((Value) p);
+        value_ref((Value) p);
+        Number *mc2 = number_negate(number_mul(p, p));
+        size_t shift = uu_mul_zu_or_saturate(it.d1, 2);
+
+        Series ss = {sin_piece_term, &mc2, shift};
+        Number *ps = number_add(series_sum(&ss, n, g), number_new_from_zu(1));
+        ps = number_truncate(number_mul(number_scale_down(p, it.d1), ps), g);
+
+        Series sc = {cos_piece_term, &mc2, shift};
+        Number *pc = number_add(series_sum(&sc, n, g), number_new_from_zu(1));
+        value_unref((Value) mc2);
+
+        // 'sin(x + y) = sin x cos y + cos x sin y', 'cos(x + y) = cos x cos y - sin x sin y'.
+        value_ref((Value) ys);
+        value_ref((Value) yc);
+        value_ref((Value) ps);
+        value_ref((Value) pc);
+        Number *ys1 = number_add(number_mul(ys, pc), number_mul(yc, ps));
+        yc = number_sub(number_mul(yc, pc), number_mul(ys, ps));
+        ys = number_truncate(ys1, g);
+        yc = number_truncate(yc, g);
+    }
+
+    ys = number_truncate(ys, ntp);
+    *s = neg ? number_negate(ys) : ys;
+    *c = number_truncate(yc, ntp);
+}
+
+// Stores 'sin a' and 'cos a', truncated to 'ntp' with an error of a few units of the last word,
+// into '*s' and '*c'. 'pi' is taken from 'state'.
+//
+// Steals (takes move references to):
+//   * 'a'.
+static void sin_cos(Number *a, State *state, NumberTruncateParams ntp, Number **s, Number **c)
+{
+    NumberTruncateParams w = {
+        .scale = uu_add_zu_or_saturate(ntp.scale, a->nwords - a->scale + 1),
+        .submod = 1,
+    };
+    Number *hp = number_div(
+        (Number *) state_get_const(state, STATE_CONST_PI, w),
+        number_new_from_zu(2),
+        w);
+
+    value_ref((Value) a);
+    value_ref((Value) hp);
+    Number *k = number_round(number_div(a, hp, (NumberTruncateParams) {.scale = 1, .submod = 1}));
+    value_ref((Value) k);
+    Number *r = number_truncate(number_sub(a, number_mul(k, hp)), constant_ntp(ntp));
+
+    Number *four = number_new_from_zu(4);
+    Number *kmod = int_mod(k, four);
+    size_t quadrant = number_to_zu(kmod);
+    value_unref((Value) kmod);
+    value_unref((Value) four);
+
+    Number *rs;
+    Number *rc;
+    sin_cos_frac(r, ntp, &rs, &rc);
+    // 'sin(r + k pi/2)' and 'cos(r + k pi/2)'.
+    switch (quadrant) {
+    case 0:
+        *s = rs;
+        *c = rc;
+        break;
+    case 1:
+        *s = rc;
+        *c = number_negate(rs);
+        break;
+    case 2:
+        *s = number_negate(rs);
+        *c = number_negate(rc);
+        break;
+    default:
+        *s = number_negate(rc);
+        *c = rs;
+        break;
+    }
+}
+
+// 'sin a', truncated to 'ntp' with an error of a few units of the last word; 'b' is unused.
+//
+// Steals (takes move references to):
+//   * 'a'.
+static Number *sin_approx(Number *a, Number *b, State *state, NumberTruncateParams ntp)
+{
+    (void) b;
+    Number *s;
+    Number *c;
+    sin_cos(a, state, ntp, &s, &c);
+    value_unref((Value) c);
+    return s;
+}
+
+// 'cos a', the same way.
+static Number *cos_approx(Number *a, Number *b, State *state, NumberTruncateParams ntp)
+{
+    (void) b;
+    Number *s;
+    Number *c;
+    sin_cos(a, state, ntp, &s, &c);
+    value_unref((Value) s);
+    return c;
+}
+
+// 'f(a, b)' truncated to 'ntp', where 'f' has an error of a few units of the last word; 'b' is
+// 'NULL' for the functions of one argument.
+//
+// 'sin', 'cos', 'tan' and 'atan' of a non-zero 'a' are never multiples of the unit of 'ntp', and
+// neither is 'atan2' off the non-negative half of the x axis, so guard words tell which way they
+// truncate, as with 'exp'. Near zero, they differ from 'a', '1' and 'a' by about 'a^2' or 'a^3', so
+// as many guard words as 'a^3' has are taken to be enough.
+//
+// Steals (takes move references to):
+//   * 'a';
+//   * 'b'.
+static Number *trig_truncate(
+        Number *a, Number *b, State *state, NumberTruncateParams ntp,
+        Number *(*f)(Number *, Number *, State *, NumberTruncateParams))
+{
+    size_t nwords = uu_add_zu_or_saturate(a->nwords, b ? b->nwords : 0);
+    size_t max_nguard = uu_add_zu_or_saturate(uu_mul_zu_or_saturate(nwords, 3), 2);
+    for (size_t nguard = 1;; nguard = uu_mul_zu_or_saturate(nguard, 2)) {
+        NumberTruncateParams g = {
+            .scale = uu_add_zu_or_saturate(ntp.scale, nguard),
+            .submod = 1,
+        };
+        value_ref((Value) a);
+        if (b)
+            value_ref((Value) b);
+        Number *r = f(a, b, state, g);
+        if (nguard >= max_nguard || !truncation_unsure(r, g, ntp)) {
+            value_unref((Value) a);
+            if (b)
+                value_unref((Value) b);
+            return number_truncate(r, ntp);
+        }
+        value_unref((Value) r);
+    }
+}
+
+Number *number_sin(Number *a, State *state, NumberTruncateParams ntp)
+{
+    if (number_is_zero(a))
+        return a;
+    return trig_truncate(a, NULL, state, ntp, sin_approx);
+}
+
+Number *number_cos(Number *a, State *state, NumberTruncateParams ntp)
+{
+    if (number_is_zero(a)) {
+        value_unref((Value) a);
+        return number_new_from_zu(1);
+    }
+    return trig_truncate(a, NULL, state, ntp, cos_approx);
+}
+
+// Number of leading zero words in the fractional part of 'a' if its integer part is zero, or zero
+// otherwise.
+static size_t nlead_frac_zeros(Number *a)
+{
+    if (!number_is_izero(a))
+        return 0;
+    size_t n = 0;
+    while (n < a->scale && !a->words[a->scale - 1 - n])
+        ++n;
+    return n;
+}
+
+// 'tan a', truncated to 'ntp' with an error of a few units of the last word; 'b' is unused.
+//
+// Steals (takes move references to):
+//   * 'a'.
+static Number *tan_approx(Number *a, Number *b, State *state, NumberTruncateParams ntp)
+{
+    (void) b;
+
+    // The error of 'cos a' is divided by 'cos^2 a', so each leading zero word of it costs two more
+    // words of precision. The first pass finds out how many there are.
+    size_t extra = 0;
+    for (;;) {
+        NumberTruncateParams w = {
+            .scale = uu_add_zu_or_saturate(ntp.scale, uu_add_zu_or_saturate(2 * extra, 3)),
+            .submod = 1,
+        };
+        Number *s;
+        Number *c;
+        value_ref((Value) a);
+        sin_cos(a, state, w, &s, &c);
+        // A zero 'cos a' has lost all of its words.
+        size_t nlost = number_is_zero(c) ? w.scale : nlead_frac_zeros(c);
+        if (nlost <= extra) {
+            value_unref((Value) a);
+            return number_div(s, c, ntp);
+        }
+        value_unref((Value) s);
+        value_unref((Value) c);
+        extra = nlost;
+    }
+}
+
+Number *number_tan(Number *a, State *state, NumberTruncateParams ntp)
+{
+    if (number_is_zero(a))
+        return a;
+    return trig_truncate(a, NULL, state, ntp, tan_approx);
+}
+
+enum {
+    // Number of Newton steps taken from the initial estimate of 'atan x', all at the lowest
+    // precision.
+    ATAN_FIRST_NSTEPS = 6,
+};
+
+// Refines the estimate 'z' of 'atan x' ('0 <= x <= 1') so that it is accurate to about 'scale'
+// words.
+//
+// Borrows (takes regular references to):
+//   * 'x'.
+//
+// Steals (takes move references to):
+//   * 'z'.
+static Number *atan_newton(Number *x, Number *z, size_t scale)
+{
+    size_t nsteps = 1;
+    if (scale > 2) {
+        z = atan_newton(x, z, scale / 2 + 1);
+    } else {
+        scale = 2;
+        nsteps = ATAN_FIRST_NSTEPS;
+    }
+
+    NumberTruncateParams w = {.scale = scale + 1, .submod = 1};
+    for (size_t i = 0; i < nsteps; ++i) {
+        Number *s;
+        Number *c;
+        value_ref((Value) z);
+        sin_cos_frac(z, w, &s, &c);
+        value_ref((Value) x);
+        value_ref((Value) c);
+        Number *d = number_sub(s, number_mul(number_truncate(x, w), c));
+        z = number_truncate(number_sub(z, number_mul(c, d)), w);
+    }
+    return z;
+}
+
+// 'atan a' for a non-zero 'a', truncated to 'ntp' with an error of a few units of the last word;
+// 'b' is unused.
+//
+// Steals (takes move references to):
+//   * 'a'.
+static Number *atan_approx(Number *a, Number *b, State *state, NumberTruncateParams ntp)
+{
+    (void) b;
+    bool neg = a->sign;
+    if (neg)
+        a = number_negate(a);
+
+    size_t scale = uu_add_zu_or_saturate(ntp.scale, 1);
+    NumberTruncateParams w = {.scale = uu_add_zu_or_saturate(scale, 1), .submod = 1};
+
+    // 'atan x = pi/2 - atan(1/x)' for 'x > 0'.
+    Number *one = number_new_from_zu(1);
+    bool inv = number_compare(a, one) == COMPARE_GREATER;
+    if (inv)
+        a = number_div(one, a, w);
+    else
+        value_unref((Value) one);
+
+    // The estimate 'x / (1 + 0.28 x^2)' is good to about two digits.
+    double x = approx_double(a);
+    double z0 = x / (1 + 0.28 * x * x);
+    Number *z = number_scale_down(number_new_from_zu(zu_from_double(z0 * 1e15)), 15);
+    z = atan_newton(a, z, scale);
+    value_unref((Value) a);
+
+    if (inv) {
+        Number *hp = number_div(
+            (Number *) state_get_const(state, STATE_CONST_PI, w),
+            number_new_from_zu(2),
+            w);
+        z = number_sub(hp, z);
+    }
+    z = number_truncate(z, ntp);
+    return neg ? number_negate(z) : z;
+}
+
+Number *number_atan(Number *a, State *state, NumberTruncateParams ntp)
+{
+    if (number_is_zero(a))
+        return a;
+    return trig_truncate(a, NULL, state, ntp, atan_approx);
+}
+
+// 'atan2(y, x)' for 'y' and 'x' not both zero, truncated to 'ntp' with an error of a few units of
+// the last word.
+//
+// Steals (takes move references to):
+//   * 'y';
+//   * 'x'.
+static Number *atan2_approx(Number *y, Number *x, State *state, NumberTruncateParams ntp)
+{
+    bool yneg = y->sign && !number_is_zero(y);
+    if (number_is_zero(x)) {
+        value_unref((Value) x);
+        value_unref((Value) y);
+        Number *hp = number_div(
+            (Number *) state_get_const(state, STATE_CONST_PI, constant_ntp(ntp)),
+            number_new_from_zu(2),
+            ntp);
+        return yneg ? number_negate(hp) : hp;
+    }
+
+    bool xneg = x->sign;
+    NumberTruncateParams w = {.scale = uu_add_zu_or_saturate(ntp.scale, 2), .submod = 1};
+    Number *z = number_div(y, x, w);
+    if (!number_is_zero(z))
+        z = atan_approx(z, NULL, state, w);
+    if (xneg) {
+        Number *pi = (Number *) state_get_const(state, STATE_CONST_PI, w);
+        z = yneg ? number_sub(z, pi) : number_add(z, pi);
+    }
+    return number_truncate(z, ntp);
+}
+
+Number *number_atan2(Number *y, Number *x, State *state, NumberTruncateParams ntp)
+{
+    // 'atan2(0, x)' is zero for 'x >= 0'.
+    if (number_is_zero(y) && !(x->sign && !number_is_zero(x))) {
+        value_unref((Value) x);
+        return y;
+    }
+    return trig_truncate(y, x, state, ntp, atan2_approx);
+}
+
+Number *number_negate(Number *a)
+{
+    a = mkuniq(a);
+    a->sign ^= 1;
+    return a;
+}
+
+Number *number_trunc(Number *a)
+{
+    return mkuniq_scale_down(a, 0);
+}
+
+Number *number_truncate(Number *a, NumberTruncateParams ntp)
+{
+    if (a->scale < ntp.scale)
+        return a;
+    if (a->scale == ntp.scale && (!ntp.scale || a->words[0] % ntp.submod == 0))
+        return a;
+    a = mkuniq_scale_down(a, ntp.scale);
+    if (ntp.scale)
+        a->words[0] -= a->words[0] % ntp.submod;
+    return a;
+}
+
+Number *number_floor(Number *a)
+{
+    if (a->sign && !number_is_fzero(a))
+        a = number_abs_add_uword(a, 1);
+    return mkuniq_scale_down(a, 0);
+}
+
+Number *number_ceil(Number *a)
+{
+    if (!a->sign && !number_is_fzero(a))
+        a = number_abs_add_uword(a, 1);
+    return mkuniq_scale_down(a, 0);
+}
+
+Number *number_round(Number *a)
+{
+    if (a->scale && a->words[a->scale - 1] >= DECI_BASE / 2)
         a = number_abs_add_uword(a, 1);
     return mkuniq_scale_down(a, 0);
 }
@@ -992,6 +4837,19 @@ greater:
 
 int number_compare(Number *a, Number *b)
 {
+    if (number_is_small(a) && number_is_small(b)) {
+        // Map sign and magnitude onto a single signed scale; "-0" compares equal to "0".
+        deci_UWORD x = number_small_word(a);
+        deci_UWORD y = number_small_word(b);
+        bool na = a->sign && x;
+        bool nb = b->sign && y;
+        if (na != nb)
+            return na ? COMPARE_LESS : COMPARE_GREATER;
+        if (x == y)
+            return COMPARE_EQ;
+        return ((x < y) ^ na) ? COMPARE_LESS : COMPARE_GREATER;
+    }
+
     char ca = a->sign;
     char cb = b->sign;
     if (ca == cb) {
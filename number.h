@@ -19,6 +19,10 @@ typedef struct {
     deci_UWORD words[];
 } Number;
 
+// Non-negative integers below this are interned by 'number_new_from_zu()' and returned by the
+// single-word fast paths of the arithmetic functions.
+#define NUMBER_SMALL_CACHE_SIZE 1024
+
 typedef void (*NumberWriter)(void *userdata, const char *buf, size_t nbuf);
 
 Number *number_new_from_zu(size_t x);
@@ -59,6 +63,80 @@ Number *number_idiv(Number *a, Number *b);
 
 Number *number_imod(Number *a, Number *b);
 
+// 'b^e mod m' in '[0, m)'. 'b', 'e' and 'm' must be integers, with 'e >= 0' and 'm > 0'.
+Number *number_mod_pow(Number *b, Number *e, Number *m);
+
+// 'gcd(a, b)', non-negative. 'a' and 'b' must be integers.
+Number *number_gcd(Number *a, Number *b);
+
+// Returns 'g = gcd(a, b)' and stores into '*x' and '*y' the cofactors with 'a * x + b * y = g' and
+// '|x| <= |b| / (2 * g)' (if 'b' is zero, 'x' is the sign of 'a'). 'a' and 'b' must be integers.
+Number *number_ext_gcd(Number *a, Number *b, Number **x, Number **y);
+
+// The inverse of 'a' modulo 'm' in '[0, m)', or 'NULL' if 'gcd(a, m) != 1'. 'a' and 'm' must be
+// integers, with 'm > 0'.
+Number *number_mod_inverse(Number *a, Number *m);
+
+// 'a^(1/n)' rounded towards zero. 'a' must be an integer, with 'n >= 1', and 'a >= 0' if 'n' is
+// even.
+Number *number_iroot(Number *a, size_t n);
+
+// 'a^(1/n)' truncated to the precision of 'ntp'; the same conditions as for 'number_iroot()' apply,
+// except that 'a' need not be an integer.
+Number *number_root(Number *a, size_t n, NumberTruncateParams ntp);
+
+// Whether the integer 'a' is probably prime: a composite passes with probability at most
+// '4^(-nrounds)'. Numbers below 'DECI_BASE' are decided exactly. 'seed' seeds the choice of bases.
+// Unlike most functions here, it does not steal 'a'.
+bool number_is_probable_prime(Number *a, size_t nrounds, uint64_t seed);
+
+// Returns a 'malloc()'ed array of the prime factors of the positive integer 'a', in ascending order
+// and repeated according to their multiplicity, and stores its size into '*nfactors'.
+Number **number_factorize(Number *a, size_t *nfactors);
+
+// The smallest prime factor of the positive integer 'a', or 'a' itself if it is 1 or a prime. A
+// small factor is found without factorizing 'a' any further.
+Number *number_smallest_prime_factor(Number *a);
+
+// The product of 'xs[0] ... xs[n - 1]', all of which are stolen (but not the array itself).
+Number *number_product(Number **xs, size_t n);
+
+// 'n!'.
+Number *number_factorial(size_t n);
+
+// 'C(n, k)' for a non-negative integer 'n'; 'k' must not be greater than 'n' if 'n >= SIZE_MAX'.
+Number *number_choice(Number *n, size_t k);
+
+// 'pi', 'e' and 'ln 2', truncated to the precision of 'ntp'.
+Number *number_pi(NumberTruncateParams ntp);
+
+Number *number_e(NumberTruncateParams ntp);
+
+Number *number_ln2(NumberTruncateParams ntp);
+
+// 'exp(a)' truncated to the precision of 'ntp'.
+Number *number_exp(Number *a, NumberTruncateParams ntp);
+
+// 'ln a' for a positive 'a', truncated to the precision of 'ntp'. 'ln 2' is taken from 'state'.
+Number *number_ln(Number *a, State *state, NumberTruncateParams ntp);
+
+// 'b^e' for a positive 'b', truncated to the precision of 'ntp'. 'ln 2' is taken from 'state'.
+Number *number_pow_real(Number *b, Number *e, State *state, NumberTruncateParams ntp);
+
+// 'sin a', 'cos a', 'tan a' and 'atan a', truncated to the precision of 'ntp'. 'pi' is taken from
+// 'state'.
+Number *number_sin(Number *a, State *state, NumberTruncateParams ntp);
+
+Number *number_cos(Number *a, State *state, NumberTruncateParams ntp);
+
+Number *number_tan(Number *a, State *state, NumberTruncateParams ntp);
+
+Number *number_atan(Number *a, State *state, NumberTruncateParams ntp);
+
+// The angle of the point '(x, y)', in '(-pi, pi]', truncated to the precision of 'ntp'; zero if
+// both are zero. 'pi' is taken from 'state'.
+Number *number_atan2(Number *y, Number *x, State *state, NumberTruncateParams ntp);
+
 Number *number_negate(Number *a);
 
 int number_compare(Number *a, Number *b);
@@ -67,6 +145,9 @@ bool number_abs_eq_uword(Number *a, deci_UWORD b);
 
 Number *number_trunc(Number *a);
 
+// 'a' truncated to the precision of 'ntp'.
+Number *number_truncate(Number *a, NumberTruncateParams ntp);
+
 Number *number_floor(Number *a);
 
 Number *number_ceil(Number *a);
@@ -95,10 +176,7 @@ Number *number_scale_down(Number *a, size_t n);
 // Multiply by 10^n.
 Number *number_scale_up(Number *a, size_t n);
 
-UU_INHEADER void number_destroy(Number *a)
-{
-    free(a);
-}
+void number_destroy(Number *a);
 
 UU_INHEADER bool number_is_zero(Number *a)
 {
@@ -117,8 +195,26 @@ UU_INHEADER bool number_is_fzero(Number *a)
     return deci_is_zero_n(a->words, a->scale);
 }
 
+// Whether 'a' is an integer that fits into a single word.
+UU_INHEADER UU_ALWAYS_INLINE bool number_is_small(Number *a)
+{
+    return a->scale == 0 && a->nwords <= 1;
+}
+
+// Requires 'number_is_small(a)'; returns the absolute value of 'a'.
+UU_INHEADER UU_ALWAYS_INLINE deci_UWORD number_small_word(Number *a)
+{
+    return a->nwords ? a->words[0] : 0;
+}
+
 UU_INHEADER size_t number_to_zu(Number *a)
 {
+    if (sizeof(deci_UWORD) <= sizeof(size_t) && UU_LIKELY(number_is_small(a))) {
+        if (a->sign && a->nwords)
+            return -1;
+        return number_small_word(a);
+    }
+
     if (a->sign) {
         if (number_is_zero(a))
             return 0;
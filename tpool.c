@@ -0,0 +1,132 @@
+// (c) 2020 shdown
+// This code is licensed under MIT license (see LICENSE.MIT for details)
+
+#include "tpool.h"
+#include <pthread.h>
+
+static pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
+// Signalled when a task is pushed, or when the workers should stop.
+static pthread_cond_t cv_work = PTHREAD_COND_INITIALIZER;
+// Broadcast when a task is finished.
+static pthread_cond_t cv_done = PTHREAD_COND_INITIALIZER;
+
+static TPoolTask *stack = NULL;
+static bool stopping = false;
+
+static pthread_t *workers = NULL;
+static size_t nworkers = 0;
+static void (*worker_at_exit)(void) = NULL;
+
+// Must be called with 'mtx' locked; unlocks it while running the task.
+static void run_locked(TPoolTask *task)
+{
+    pthread_mutex_unlock(&mtx);
+    task->func(task->arg);
+    pthread_mutex_lock(&mtx);
+    task->done = true;
+    pthread_cond_broadcast(&cv_done);
+}
+
+static inline TPoolTask *pop_locked(void)
+{
+    TPoolTask *task = stack;
+    if (task)
+        stack = task->next;
+    return task;
+}
+
+static void *worker_main(void *arg)
+{
+    (void) arg;
+
+    pthread_mutex_lock(&mtx);
+    while (!stopping) {
+        TPoolTask *task = pop_locked();
+        if (task)
+            run_locked(task);
+        else
+            pthread_cond_wait(&cv_work, &mtx);
+    }
+    pthread_mutex_unlock(&mtx);
+
+    if (worker_at_exit)
+        worker_at_exit();
+    return NULL;
+}
+
+bool tpool_start(size_t n, void (*at_exit)(void))
+{
+    tpool_stop();
+    if (!n)
+        return true;
+
+    worker_at_exit = at_exit;
+    workers = uu_xmalloc(n, sizeof(pthread_t));
+    for (; nworkers < n; ++nworkers) {
+        if (pthread_create(&workers[nworkers], NULL, worker_main, NULL) != 0)
+            break;
+    }
+    if (!nworkers) {
+        free(workers);
+        workers = NULL;
+        return false;
+    }
+    return true;
+}
+
+void tpool_stop(void)
+{
+    if (!nworkers)
+        return;
+
+    pthread_mutex_lock(&mtx);
+    stopping = true;
+    pthread_cond_broadcast(&cv_work);
+    pthread_mutex_unlock(&mtx);
+
+    for (size_t i = 0; i < nworkers; ++i)
+        pthread_join(workers[i], NULL);
+
+    free(workers);
+    workers = NULL;
+    nworkers = 0;
+    stopping = false;
+}
+
+size_t tpool_nworkers(void)
+{
+    return nworkers;
+}
+
+void tpool_submit(TPoolTask *task)
+{
+    task->done = false;
+
+    if (!nworkers) {
+        task->func(task->arg);
+        task->done = true;
+        return;
+    }
+
+    pthread_mutex_lock(&mtx);
+    task->next = stack;
+    stack = task;
+    pthread_cond_signal(&cv_work);
+    pthread_mutex_unlock(&mtx);
+}
+
+void tpool_wait(TPoolTask *task)
+{
+    if (!nworkers)
+        return;
+
+    pthread_mutex_lock(&mtx);
+    while (!task->done) {
+        TPoolTask *other = pop_locked();
+        if (other)
+            run_locked(other);
+        else
+            pthread_cond_wait(&cv_done, &mtx);
+    }
+    pthread_mutex_unlock(&mtx);
+}
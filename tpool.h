@@ -0,0 +1,37 @@
+// (c) 2020 shdown
+// This code is licensed under MIT license (see LICENSE.MIT for details)
+
+#pragma once
+
+#include "common.h"
+
+// A minimal fork-join thread pool. Tasks are kept on a shared LIFO stack; a thread waiting for a
+// task runs queued tasks in the meantime, so tasks may submit and wait for subtasks of their own
+// without tying up a worker.
+
+typedef struct TPoolTask {
+    void (*func)(void *arg);
+    void *arg;
+    // Private.
+    struct TPoolTask *next;
+    bool done;
+} TPoolTask;
+
+// Starts 'nworkers' worker threads, in addition to the calling one; stops the current ones first,
+// if any. 'at_exit' (if not NULL) is called by each worker thread right before it exits.
+//
+// Returns false if no worker thread could be started; the pool is then left stopped.
+bool tpool_start(size_t nworkers, void (*at_exit)(void));
+
+// Stops and joins all the worker threads. Must not be called while tasks are pending.
+void tpool_stop(void);
+
+// Returns the number of worker threads (0 if the pool is stopped).
+size_t tpool_nworkers(void);
+
+// Schedules 'task' ('task->func' and 'task->arg' must be set). If the pool is stopped, runs it
+// right away.
+void tpool_submit(TPoolTask *task);
+
+// Waits until 'task', which must have been submitted, is finished.
+void tpool_wait(TPoolTask *task);
@@ -0,0 +1,186 @@
+// (c) 2020 shdown
+// This code is licensed under MIT license (see LICENSE.MIT for details)
+
+// Measures the crossover points between the multiplication and division algorithms of 'fancy.c'
+// on this machine, and writes them in the format read by 'fancy_cutoffs_load()'.
+//
+// Each cutoff is found the way GMP's 'tuneup' does it: for a growing operand size 'n', the
+// operation is timed once with the cutoff just above 'n', so that the lower algorithm runs, and
+// once with the cutoff at 'n', so that the upper one runs at the top level only. The cutoff is the
+// first size from which the upper algorithm keeps winning. The cutoffs are tuned from the lowest
+// tier up, each with the tiers above it disabled.
+
+#include "../fancy.h"
+#include "../libdeci-newt/decinewt.h"
+#include <math.h>
+#include <time.h>
+
+enum {
+    // Number of timings taken of each operation; the fastest one counts.
+    NREPS = 5,
+    // Number of consecutive sizes at which the upper algorithm has to win.
+    NWINS = 3,
+};
+
+// Minimum duration of one timing, in seconds.
+static const double MIN_SECONDS = 0.002;
+
+static FancyCutoffs cutoffs;
+
+static deci_UWORD *wa;
+static deci_UWORD *wb;
+static deci_UWORD *wtmp;
+static deci_UWORD *wout;
+
+static double now(void)
+{
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0) {
+        perror("clock_gettime");
+        abort();
+    }
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Fills 'w' with pseudo-random words; the top one is never zero.
+static void fill_random(deci_UWORD *w, size_t n)
+{
+    static uint64_t x = 88172645463325252ULL;
+    for (size_t i = 0; i < n; ++i) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        w[i] = x % DECI_BASE;
+    }
+    if (n && !w[n - 1])
+        w[n - 1] = 1;
+}
+
+static void op_mul(size_t n)
+{
+    fancy_mul(wa, n, wb, n, wout);
+}
+
+static void op_div(size_t n)
+{
+    deci_memcpy(wtmp, wa, 2 * n);
+    (void) fancy_div(wtmp, 2 * n, wb, n);
+}
+
+static double time_op(void (*op)(size_t n), size_t n)
+{
+    double best = INFINITY;
+    for (int i = 0; i < NREPS; ++i) {
+        size_t niters = 0;
+        double start = now();
+        double elapsed;
+        do {
+            op(n);
+            ++niters;
+        } while ((elapsed = now() - start) < MIN_SECONDS);
+        if (best > elapsed / niters)
+            best = elapsed / niters;
+    }
+    return best;
+}
+
+// Returns the first size in '[lo, hi]' from which setting '*cutoff' to the size makes 'op'
+// faster, or 'hi' if there is none.
+static size_t crossover(const char *name, size_t *cutoff, size_t lo, size_t hi, void (*op)(size_t))
+{
+    fprintf(stderr, "Tuning %s...\n", name);
+
+    size_t first_win = hi;
+    int nwins = 0;
+    for (size_t n = lo; n < hi; n = n + 1 + n / 16) {
+        *cutoff = n + 1;
+        fancy_set_cutoffs(cutoffs);
+        double below = time_op(op, n);
+
+        *cutoff = n;
+        fancy_set_cutoffs(cutoffs);
+        double above = time_op(op, n);
+
+        fprintf(stderr, "  %zu\t%.3f\n", n, above / below);
+
+        if (above < below) {
+            if (!nwins++)
+                first_win = n;
+            if (nwins == NWINS) {
+                *cutoff = first_win;
+                return first_win;
+            }
+        } else {
+            nwins = 0;
+            first_win = hi;
+        }
+    }
+    *cutoff = hi;
+    return hi;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 2) {
+        fprintf(stderr, "USAGE: calx-tune [OUTPUT_FILE]\n");
+        return 2;
+    }
+
+    // The largest sizes the searches below go up to.
+    const size_t MUL_MAX = 4000;
+    const size_t DIV_MAX = 4000;
+
+    fancy_set_kernels(fancy_detect_kernels());
+
+    wa = uu_xmalloc(2 * DIV_MAX, sizeof(deci_UWORD));
+    wb = uu_xmalloc(DIV_MAX, sizeof(deci_UWORD));
+    wtmp = uu_xmalloc(2 * DIV_MAX, sizeof(deci_UWORD));
+    wout = uu_xmalloc(2 * MUL_MAX, sizeof(deci_UWORD));
+    fill_random(wa, 2 * DIV_MAX);
+    fill_random(wb, DIV_MAX);
+
+    cutoffs = fancy_get_cutoffs();
+    size_t mul_parallel = cutoffs.mul_parallel;
+
+    cutoffs.mul_parallel = SIZE_MAX;
+    cutoffs.mul_karatsuba = SIZE_MAX;
+    cutoffs.mul_toom3 = SIZE_MAX;
+    crossover("mul_basecase", &cutoffs.mul_basecase, FANCY_MUL_BASECASE_MIN, 200, op_mul);
+    crossover("mul_karatsuba", &cutoffs.mul_karatsuba, cutoffs.mul_basecase, 1000, op_mul);
+    crossover("mul_toom3", &cutoffs.mul_toom3, cutoffs.mul_karatsuba, MUL_MAX, op_mul);
+    cutoffs.mul_parallel = mul_parallel;
+
+    // Division by 'n' words of a '2 * n'-word number.
+    cutoffs.div_bz = SIZE_MAX;
+    crossover("div_basecase", &cutoffs.div_basecase, FANCY_DIV_BASECASE_MIN, 500, op_div);
+    size_t div_bz_min = cutoffs.div_basecase > DECINEWT_MIN ? cutoffs.div_basecase : DECINEWT_MIN;
+    crossover("div_bz", &cutoffs.div_bz, div_bz_min, DIV_MAX, op_div);
+
+    FILE *out = stdout;
+    if (argc == 2 && !(out = fopen(argv[1], "w"))) {
+        perror(argv[1]);
+        return 1;
+    }
+    time_t t = time(NULL);
+    char date[64];
+    strftime(date, sizeof(date), "%Y-%m-%d", localtime(&t));
+    fprintf(out, "# Generated by calx-tune on %s (%s kernels).\n",
+            date, fancy_kernels_name(fancy_get_kernels()));
+    fprintf(out, "mul_basecase=%zu\n", cutoffs.mul_basecase);
+    fprintf(out, "mul_karatsuba=%zu\n", cutoffs.mul_karatsuba);
+    fprintf(out, "mul_toom3=%zu\n", cutoffs.mul_toom3);
+    fprintf(out, "mul_parallel=%zu\n", cutoffs.mul_parallel);
+    fprintf(out, "div_basecase=%zu\n", cutoffs.div_basecase);
+    fprintf(out, "div_bz=%zu\n", cutoffs.div_bz);
+    fprintf(out, "gcd_half=%zu\n", cutoffs.gcd_half);
+    if (out != stdout ? fclose(out) != 0 : fflush(out) != 0) {
+        perror(argc == 2 ? argv[1] : "(stdout)");
+        return 1;
+    }
+
+    free(wa);
+    free(wb);
+    free(wtmp);
+    free(wout);
+    return 0;
+}
@@ -67,6 +67,12 @@ typedef struct {
     size_t capacity;
 } GlobalList;
 
+typedef struct {
+    MaybeValue value;
+    // Number of words after the point 'value' is computed to.
+    size_t scale;
+} ConstCache;
+
 struct State {
     xHt globals_table;
     GlobalList globals;
@@ -74,6 +80,8 @@ struct State {
     ScratchPad *pad;
 
     NumberTruncateParams ntp;
+
+    ConstCache consts[STATE_NCONSTS];
 };
 
 State *state_new(void)
@@ -84,6 +92,7 @@ State *state_new(void)
         .globals = {NULL, 0, 0},
         .pad = NULL,
         .ntp = ntp_from_prec(20),
+        .consts = {{NULL, 0}},
     };
     return state;
 }
@@ -94,6 +103,8 @@ void state_destroy(State *state)
     for (size_t i = 0; i < state->globals.size; ++i)
         maybe_value_unref(state->globals.data[i]);
     free(state->globals.data);
+    for (int i = 0; i < STATE_NCONSTS; ++i)
+        maybe_value_unref(state->consts[i].value);
     free(state);
 }
 
@@ -491,6 +502,9 @@ const char *value_kind_name_long(char kind)
 //   * 'b'.
 static inline UU_ALWAYS_INLINE bool values_equal(Value a, Value b)
 {
+    // Small integers are interned, so identical pointers are common here.
+    if (a == b)
+        return true;
     if (a->kind != b->kind)
         return false;
     switch (a->kind) {
@@ -594,15 +608,37 @@ String *append_string_repr(String *s, Value v)
 // Writes the result into '*out'.
 static bool do_pow(State *state, Number *b, Number *e, Value *out)
 {
-    if (UU_UNLIKELY(e->sign && !number_is_zero(e))) {
-        state_prepare_error(state, "exponent is negative");
-        return false;
+    bool eint = number_is_fzero(e);
+    bool eneg = e->sign && !number_is_zero(e);
+    if (UU_LIKELY(eint && !eneg)) {
+        *out = (Value) number_pow(b, e);
+        return true;
     }
-    if (UU_UNLIKELY(!number_is_fzero(e))) {
-        state_prepare_error(state, "fraction part of exponent is non-zero");
+
+    if (number_is_zero(b)) {
+        if (UU_UNLIKELY(eneg)) {
+            state_prepare_error(state, "division by zero");
+            return false;
+        }
+        value_unref((Value) b);
+        value_unref((Value) e);
+        *out = (Value) number_new_from_zu(0);
+        return true;
+    }
+
+    if (eint) {
+        *out = (Value) number_div(
+            number_new_from_zu(1),
+            number_pow(b, number_negate(e)),
+            state->ntp);
+        return true;
+    }
+
+    if (UU_UNLIKELY(b->sign)) {
+        state_prepare_error(state, "negative base with fractional exponent");
         return false;
     }
-    *out = (Value) number_pow(b, e);
+    *out = (Value) number_pow_real(b, e, state, state->ntp);
     return true;
 }
 
@@ -1132,6 +1168,24 @@ void state_set_ntp(State *s, NumberTruncateParams ntp)
     s->ntp = ntp;
 }
 
+Value state_get_const(State *s, int c, NumberTruncateParams ntp)
+{
+    static Number *(*const COMPUTE[STATE_NCONSTS])(NumberTruncateParams) = {
+        [STATE_CONST_PI] = number_pi,
+        [STATE_CONST_E] = number_e,
+        [STATE_CONST_LN2] = number_ln2,
+    };
+
+    ConstCache *cc = &s->consts[c];
+    if (!cc->value || cc->scale < ntp.scale) {
+        maybe_value_unref(cc->value);
+        cc->value = (Value) COMPUTE[c]((NumberTruncateParams) {.scale = ntp.scale, .submod = 1});
+        cc->scale = ntp.scale;
+    }
+    value_ref(cc->value);
+    return (Value) number_truncate((Number *) cc->value, ntp);
+}
+
 static inline void value_stack_push_copies(ValueStack *vs, Value *src, size_t nsrc)
 {
     value_stack_ensure(vs, nsrc);
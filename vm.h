@@ -267,6 +267,19 @@ NumberTruncateParams state_get_ntp(State *s);
 
 void state_set_ntp(State *s, NumberTruncateParams ntp);
 
+enum {
+    STATE_CONST_PI,
+    STATE_CONST_E,
+    STATE_CONST_LN2,
+
+    STATE_NCONSTS,
+};
+
+// Returns the constant 'c' (one of 'STATE_CONST_*') truncated to 'ntp'. The constant is computed
+// once per precision: it is kept in 's', and a request at the same or a lower precision truncates
+// the kept value.
+Value state_get_const(State *s, int c, NumberTruncateParams ntp);
+
 __attribute__((noreturn, format(printf, 2, 3)))
 void state_throw(State *s, const char *fmt, ...);
 